@@ -21,10 +21,14 @@ SOFTWARE.
 */
 
 #include <cassert>
+#include <cstring>
 #include <iomanip>
 #include <sstream>
 #include <cmath>  
-#include <random>
+#include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "autonomous_car.h"
 #include "logging.h"
@@ -60,10 +64,13 @@ autonomous_car::autonomous_car(display &display, world &world, int id, double x,
     time_in_this_state_us = 0;
     obstruction = OBSTRUCTION_NONE;
     distance_road_is_clear = NO_VALUE;
+    road_clear_beyond_scan = false;
     for (auto& xl : x_line) {
         xl = MAX_VIEW_WIDTH/2;
     }
     fullgap.valid = false;
+    trace_len = 0;
+    trace_state = state;
     continuing_from_stop_left_is_possible = false;
     continuing_from_stop_straight_is_possible = false;
     continuing_from_stop_right_is_possible = false;
@@ -134,16 +141,120 @@ void autonomous_car::draw_dashboard(int pid)
     
     // autonomous dash line 2: distance road is clear
     s.str("");
-    s << "ROAD CLR: " << distance_road_is_clear << " " << obstruction_string(obstruction);
+    s << "ROAD CLR: " << (road_clear_beyond_scan ? ">=" : "") << distance_road_is_clear << " " 
+      << obstruction_string(obstruction);
     d.text_draw(s.str(), base_row+1, 1, pid, false, 0, 1);
 }
 
+// -----------------  LAZY VIEW  ---------------------------------------------------
+
+autonomous_car::lazy_view::lazy_view(world &world, int x, int y, double dir) : w(world)
+{
+    w.init_view_origin(vo, x, y, dir, MAX_VIEW_WIDTH, MAX_VIEW_HEIGHT);
+    memset(valid, 0, sizeof(valid));
+}
+
+int autonomous_car::far_view_stride = 1;
+
+// priority of the pixel colors in the far view's cells, highest wins; vehicles 
+// and the end of road win over red, so that they aren't hidden when red is being
+// ignored, and yellow wins over red so the center line is kept where a stop line 
+// crosses it; colors that shouldn't be in the view win over everything
+static_assert(display::TRANSPARENT == 11, "far_view_priority is in display color order");
+static const unsigned char far_view_priority[display::TRANSPARENT+1] = {
+    2,      // RED
+    8,      // ORANGE
+    3,      // YELLOW
+    4,      // GREEN
+    5,      // BLUE
+    10,     // PURPLE
+    1,      // BLACK
+    9,      // WHITE
+    10,     // GRAY
+    6,      // PINK
+    10,     // LIGHT_BLUE
+    10,     // TRANSPARENT
+};
+
+void autonomous_car::lazy_view::sample(int y, int chunk)
+{
+    int x = chunk * VIEW_CHUNK;
+    int n = (x + VIEW_CHUNK <= MAX_VIEW_WIDTH ? VIEW_CHUNK : MAX_VIEW_WIDTH - x);
+
+    // near rows, or far rows when there is no far view stride, are sampled directly
+    if (far_view_stride == 1 || y > FAR_VIEW_Y) {
+        w.get_view_segment(vo, y, x, n, &pixels[y][x]);
+        set_class_bits(y, chunk);
+        valid[y] |= 1 << chunk;
+        return;
+    }
+
+    // otherwise sample the chunk in all the rows of y's cell, and reduce them 
+    // to the highest priority pixel at each x
+    int y_first = FAR_VIEW_Y - (FAR_VIEW_Y - y) / far_view_stride * far_view_stride;
+    int y_last = std::max(y_first - far_view_stride + 1, 0);
+    unsigned char cell[VIEW_CHUNK];
+
+    w.get_view_segment(vo, y_first, x, n, cell);
+    for (int y_idx = y_first - 1; y_idx >= y_last; y_idx--) {
+        unsigned char row[VIEW_CHUNK];
+        w.get_view_segment(vo, y_idx, x, n, row);
+        for (int i = 0; i < n; i++) {
+            if (far_view_priority[row[i]] > far_view_priority[cell[i]]) {
+                cell[i] = row[i];
+            }
+        }
+    }
+    for (int y_idx = y_first; y_idx >= y_last; y_idx--) {
+        memcpy(&pixels[y_idx][x], cell, n);
+        set_class_bits(y_idx, chunk);
+        valid[y_idx] |= 1 << chunk;
+    }
+}
+
+void autonomous_car::lazy_view::set(int y, int x, unsigned char pixel)
+{
+    check_sampled(y, x);
+    pixels[y][x] = pixel;
+    set_class_bits(y, x / VIEW_CHUNK);
+}
+
+void autonomous_car::lazy_view::set_class_bits(int y, int chunk)
+{
+    int x = chunk * VIEW_CHUNK;
+    unsigned int yellow, green, black;
+
+#if defined(__SSE2__)
+    __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&pixels[y][x]));
+    yellow = _mm_movemask_epi8(_mm_cmpeq_epi8(px, _mm_set1_epi8(display::YELLOW)));
+    green  = _mm_movemask_epi8(_mm_cmpeq_epi8(px, _mm_set1_epi8(display::GREEN)));
+    black  = _mm_movemask_epi8(_mm_cmpeq_epi8(px, _mm_set1_epi8(display::BLACK)));
+#else
+    yellow = green = black = 0;
+    for (int i = 0; i < VIEW_CHUNK; i++) {
+        yellow |= (pixels[y][x+i] == display::YELLOW) << i;
+        green  |= (pixels[y][x+i] == display::GREEN) << i;
+        black  |= (pixels[y][x+i] == display::BLACK) << i;
+    }
+#endif
+
+    // the last chunk of a row extends past the view, mask off the pixels that aren't in it
+    if (x + VIEW_CHUNK > MAX_VIEW_WIDTH) {
+        unsigned int in_view = (1u << (MAX_VIEW_WIDTH - x)) - 1;
+        yellow &= in_view;
+        green  &= in_view;
+        black  &= in_view;
+    }
+
+    cls_bits[VIEW_YELLOW][y][chunk] = yellow;
+    cls_bits[VIEW_GREEN][y][chunk]  = green;
+    cls_bits[VIEW_ROAD][y][chunk]   = yellow | black;
+}
+
 // -----------------  UPDATE CONTROLS VIRTUAL FUNCTION  -----------------------------
 
 void autonomous_car::update_controls(double microsecs)
 {
-    view_t view;
-    
     // if failed do nothing
     if (get_failed()) {
         return;
@@ -152,19 +263,18 @@ void autonomous_car::update_controls(double microsecs)
     // debug print seperator
     DEBUG_ID("--------------------------------------------------------" << endl);
 
-    // get the front view
-    world &w = get_world();
-    w.get_view(get_x(), get_y(), get_dir(), MAX_VIEW_WIDTH, MAX_VIEW_HEIGHT, reinterpret_cast<unsigned char *>(view));
+    // get the front view; it is sampled from the world as scan_road reads it
+    lazy_view view(get_world(), get_x(), get_y(), get_dir());
 
     // the front of car sometimes extends a little beyone yo-8;
     // check for this and clear these pixels
     for (int y_idx = yo-8; y_idx >= yo-9; y_idx--) {
         for (int x_idx = xo-5; x_idx <= xo+5; x_idx++) {
-            if (view[y_idx][x_idx] == display::WHITE) {
-                view[y_idx][x_idx] = display::BLACK;    
+            if (view(y_idx, x_idx) == display::WHITE) {
+                view.set(y_idx, x_idx, display::BLACK);    
             }
-            if (view[y_idx][x_idx] == display::BLUE) {
-                view[y_idx][x_idx] = display::BLACK;    
+            if (view(y_idx, x_idx) == display::BLUE) {
+                view.set(y_idx, x_idx, display::BLACK);    
             }
         }
     }
@@ -238,7 +348,7 @@ void autonomous_car::update_controls(double microsecs)
     }
 }
 
-void autonomous_car::scan_road(view_t &view)
+void autonomous_car::scan_road(lazy_view &view)
 {
     int              max_x_line;
     int              y;
@@ -247,6 +357,12 @@ void autonomous_car::scan_road(view_t &view)
     double           minigap_slope;
     string           minigap_type_str;
     bool             end_of_road_detected;
+    double           x_predicted[MAX_VIEW_HEIGHT];
+    bool             predicting;
+    int              new_trace_len;
+    int              max_distance;
+    bool             max_distance_reached;
+    double           cell_x;
     
     // init locals
     max_x_line           = 0;
@@ -255,11 +371,29 @@ void autonomous_car::scan_road(view_t &view)
     minigap_y_last       = NO_VALUE;
     minigap_slope        = 0;
     end_of_road_detected = false;
+    new_trace_len        = 0;
+    max_distance         = scan_distance_needed();
+    max_distance_reached = false;
+    cell_x               = NO_VALUE;
 
     // initial debug prints
     DEBUG_ID("world - y,x " << get_y() << " " << get_x() << " dir " << get_dir() << endl);
     DEBUG_ID("state - " << state_string(state) << endl);
 
+    // the car's direction doesn't change during scan_road, so the coordinate 
+    // conversions can share its cos and sin
+    dir_cos = cos(get_dir() * (M_PI/180));
+    dir_sin = sin(get_dir() * (M_PI/180));
+
+    // predict the center line from the last scan's trace; the trace isn't used 
+    // after a state change, because whether red is an obstruction depends on state
+    if (trace_len > 0 && trace_state == state) {
+        predict_x_line(x_predicted);
+        predicting = true;
+    } else {
+        predicting = false;
+    }
+
     // if a fullgap is valid then
     //  . convert its saved world coordinates to the coords in the current view
     //  . if the end of the fullgap is before the begining of this view then 
@@ -285,6 +419,9 @@ void autonomous_car::scan_road(view_t &view)
     // this loop determines the x location of the center line, 
     while (true) {
         double slope, x_last, x;
+        bool trace_row = false;
+        bool scanned_row = false;
+        bool cell_row = false;
 
         // determine the slope of the center line over the past 10 feet,
         // if that much has not yet been scanned then set slope to 0
@@ -333,13 +470,37 @@ void autonomous_car::scan_road(view_t &view)
                                     (fullgap.y_end_view - fullgap.y_start_view);
             x = x_last + fullgap_slope;
             DEBUG_ID("fullgap - got y,x = " << y << " " << x << " - fullgap_slope " << fullgap_slope << endl);
+        } else if (cell_x != NO_VALUE && lazy_view::same_cell(y, y + 1)) {
+            // the rows of a far view cell are the same, so the center line is
+            // at the same x, and the row is clear as the cell's first row was
+            x = cell_x;
+            trace_row = true;
+            cell_row = true;
+            DEBUG_ID("cell - got y,x = " << y << " " << x << endl);
+        } else if (predicting && x_predicted[y] != NO_VALUE && 
+                   y % TRACE_VERIFY_INTERVAL != 0 && 
+                   y - TRACE_END_ROWS >= 0 && x_predicted[y-TRACE_END_ROWS] != NO_VALUE) 
+        {
+            x = x_predicted[y];
+            trace_row = true;
+            DEBUG_ID("predict - got y,x = " << y << " " << x << endl);
         } else {
             x = scan_across_for_center_line(view, y, x_last+slope);
+            trace_row = true;
+            scanned_row = true;
             if (x != NO_VALUE) {
                 DEBUG_ID("scan - got y,x = " << y << " " << x << " - slope " << slope << endl);
             } else {
                 DEBUG_ID("scan - got y,x = " << y << " NO_VALUE" << " - slope " << slope << endl);
             }
+
+            // stop predicting once a scanned row disagrees with the prediction
+            if (predicting && x_predicted[y] != NO_VALUE && 
+                (x == NO_VALUE || fabs(x - x_predicted[y]) > 1)) 
+            {
+                DEBUG_ID("predict - stopped at y = " << y << endl);
+                predicting = false;
+            }
         }
 
         // check if above code has determined location of center line, at y
@@ -352,14 +513,24 @@ void autonomous_car::scan_road(view_t &view)
             }
 
             // check for loop termination based on road not clear 
-            obs = scan_across_for_obstruction(view, y, x); 
-            if (obs != OBSTRUCTION_NONE) {
-                DEBUG_ID("done - at y = " << y << ", because " << obstruction_string(obs) << endl);
-                break;
+            if (!cell_row) {
+                obs = scan_across_for_obstruction(view, y, x); 
+                if (obs != OBSTRUCTION_NONE) {
+                    DEBUG_ID("done - at y = " << y << ", because " << obstruction_string(obs) << endl);
+                    break;
+                }
             }
 
-            // add location of center_line to x_line array
+            // add location of center_line to x_line array, and to the trace if
+            // it was found by scanning; predicted rows are left out of the trace, 
+            // so that the next prediction is anchored to the scanned rows and
+            // errors in the prediction can't build up from one scan to the next
             x_line[max_x_line++] = x;
+            cell_x = (trace_row ? x : NO_VALUE);
+            if (scanned_row) {
+                coord_convert_view_to_fixed(y, x, trace_y_fixed[new_trace_len], trace_x_fixed[new_trace_len]);
+                new_trace_len++;
+            }
             y--;
 
             // if y is too close to view top then scan is complete
@@ -369,6 +540,15 @@ void autonomous_car::scan_road(view_t &view)
                 break;
             }
 
+            // if the road is clear as far as set_car_controls can make use of then 
+            // scan is complete
+            if (max_x_line >= max_distance) {
+                DEBUG_ID("done - at y = " << y << ", because road is clear for " << max_x_line << endl);
+                obs = OBSTRUCTION_NONE;
+                max_distance_reached = true;
+                break;
+            }
+
             // continue
             continue;
         }
@@ -424,9 +604,7 @@ void autonomous_car::scan_road(view_t &view)
                 continuing_from_stop_right_is_possible = (y_right != NO_VALUE);
                 if (y_straight != NO_VALUE || y_left != NO_VALUE || y_right != NO_VALUE) {
                     while (true) {
-                        static std::default_random_engine generator(microsec_timer());
-                        static std::uniform_int_distribution<int> rand_0_to_2(0,2);
-                        int n = rand_0_to_2(generator);
+                        int n = random_uniform_int(0,2);
                         assert(n >= 0 && n <= 2);
                         if (n == 0 && y_straight != NO_VALUE) {
                             fullgap_y_end_view = y_straight;
@@ -489,7 +667,10 @@ void autonomous_car::scan_road(view_t &view)
 
     // save private values
     distance_road_is_clear = max_x_line;
+    road_clear_beyond_scan = max_distance_reached;
     obstruction = obs;
+    trace_len = new_trace_len;
+    trace_state = state;
 
 #ifdef ENABLE_LOGGING_AT_DEBUG_LEVEL
     // debug print 
@@ -505,28 +686,54 @@ void autonomous_car::scan_road(view_t &view)
 #endif
 }
 
-double autonomous_car::scan_across_for_center_line(view_t &view, int y, double x_double)
+// predict_x_line converts the last scan's trace to the current view, and returns 
+// the x of the center line at each view row the trace covers, or NO_VALUE; rows
+// between two trace points are interpolated, if the points are no further apart
+// than the rows scanned to verify a prediction
+void autonomous_car::predict_x_line(double x_predicted[MAX_VIEW_HEIGHT])
+{
+    double y_prev = NO_VALUE, x_prev = NO_VALUE;
+
+    for (int y = 0; y < MAX_VIEW_HEIGHT; y++) {
+        x_predicted[y] = NO_VALUE;
+    }
+
+    for (int i = 0; i < trace_len; i++) {
+        double y_view, x_view;
+        coord_convert_fixed_to_view(trace_y_fixed[i], trace_x_fixed[i], y_view, x_view);
+
+        // the trace runs away from the car, so y_view decreases
+        if (y_prev != NO_VALUE && y_prev - y_view > 0 && y_prev - y_view < TRACE_VERIFY_INTERVAL + 2) {
+            for (int y = floor(y_prev); y > y_view; y--) {
+                if (y >= 0 && y < MAX_VIEW_HEIGHT) {
+                    x_predicted[y] = x_prev + (x_view - x_prev) * (y_prev - y) / (y_prev - y_view);
+                }
+            }
+        }
+        y_prev = y_view;
+        x_prev = x_view;
+    }
+}
+
+double autonomous_car::scan_across_for_center_line(lazy_view &view, int y, double x_double)
 {
     int x = round(x_double);
-    int x_found_start = NO_VALUE;
-    int x_found_end   = NO_VALUE;
 
     assert(y >= 0 && y < MAX_VIEW_HEIGHT);
     assert(x-5 >= 0 && x+5 < MAX_VIEW_WIDTH);
 
-    for (int x_idx = x-5; x_idx <= x+5; x_idx++) {
-        if (view[y][x_idx] == display::YELLOW) {
-            if (x_found_start == NO_VALUE) {
-                x_found_start = x_idx;
-            }
-            x_found_end = x_idx;
-        }
+    // the center line spans from the first to the last yellow pixel within x-5 to x+5
+    unsigned int yellow = view.class_bits(VIEW_YELLOW, y, x-5, 11);
+    if (yellow == 0) {
+        return NO_VALUE;
     }
+    int x_found_start = x-5 + __builtin_ctz(yellow);
+    int x_found_end   = x-5 + 31 - __builtin_clz(yellow);
 
-    return (x_found_start == NO_VALUE ? NO_VALUE : (double)(x_found_start + x_found_end) / 2);
+    return (double)(x_found_start + x_found_end) / 2;
 }
 
-enum autonomous_car::obstruction autonomous_car::scan_across_for_obstruction(view_t &view, int y, double x_double)
+enum autonomous_car::obstruction autonomous_car::scan_across_for_obstruction(lazy_view &view, int y, double x_double)
 {
     enum obstruction obs = OBSTRUCTION_NONE;
     int x = round(x_double);
@@ -536,35 +743,62 @@ enum autonomous_car::obstruction autonomous_car::scan_across_for_obstruction(vie
     assert(y >= 0 && y < MAX_VIEW_HEIGHT);
     assert(x >= 0 && x+10 < MAX_VIEW_WIDTH);
 
-    for (int x_idx = x; x_idx <= x+10; x_idx++) {
-        unsigned char pixel = view[y][x_idx];
-        if (pixel != display::YELLOW && pixel != display::BLACK) {
-            if (pixel == display::RED && state == STATE_CONTINUING_FROM_STOP_LINE) {
-                continue;
-            }
+    // usually all the pixels are road, and there's nothing more to check
+    if (view.class_bits(VIEW_ROAD, y, x, 11) == 0x7ff) {
+        return OBSTRUCTION_NONE;
+    }
 
-            if (pixel == display::GREEN) {
-                obs = OBSTRUCTION_END_OF_ROAD;
-            } else if (pixel == display::RED) {
-                obs = OBSTRUCTION_STOP_LINE;
-            } else if (pixel == display::WHITE) {
-                obs = OBSTRUCTION_FRONT_VEHICLE;
-            } else if (pixel == display::ORANGE) {
-                obs = OBSTRUCTION_REAR_VEHICLE;
-            } else if (pixel == display::BLUE || pixel == display::PINK) {
-                obs = OBSTRUCTION_REAR_VEHICLE;
-                continue; 
-            } else {
-                assert(0);
-            }
-            break;
+    // otherwise classify the 11 pixels in one pass, as a bit mask per color; the
+    // result is the same as checking the pixels from left to right, where the first 
+    // green, red, white or orange pixel ends the check, and blue or pink pixels
+    // (the sides of a vehicle) are a rear vehicle obstruction unless something 
+    // else is found; red is ignored when continuing from a stop line
+    const unsigned char * p = view.row(y, x, 11);
+#if defined(__SSE2__)
+    __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    auto bits = [&px](unsigned char color) -> unsigned int {
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(px, _mm_set1_epi8(color))) & 0x7ff;
+    };
+#else
+    auto bits = [p](unsigned char color) -> unsigned int {
+        unsigned int b = 0;
+        for (int i = 0; i < 11; i++) {
+            b |= (p[i] == color) << i;
         }
+        return b;
+    };
+#endif
+    unsigned int red     = bits(display::RED);
+    unsigned int green   = bits(display::GREEN);
+    unsigned int white   = bits(display::WHITE);
+    unsigned int orange  = bits(display::ORANGE);
+    unsigned int side    = bits(display::BLUE) | bits(display::PINK);
+    unsigned int road    = bits(display::YELLOW) | bits(display::BLACK);
+    unsigned int unknown = ~(road | red | green | white | orange | side) & 0x7ff;
+
+    if (state == STATE_CONTINUING_FROM_STOP_LINE) {
+        red = 0;
+    }
+    unsigned int end = green | red | white | orange;
+    unsigned int first = end & -end;
+    assert((unknown & (first - 1)) == 0);
+
+    if (first & green) {
+        obs = OBSTRUCTION_END_OF_ROAD;
+    } else if (first & red) {
+        obs = OBSTRUCTION_STOP_LINE;
+    } else if (first & white) {
+        obs = OBSTRUCTION_FRONT_VEHICLE;
+    } else if (first & orange) {
+        obs = OBSTRUCTION_REAR_VEHICLE;
+    } else if (side) {
+        obs = OBSTRUCTION_REAR_VEHICLE;
     }
 
     return obs;
 }
 
-bool autonomous_car::scan_ahead_for_end_of_road(view_t &view, int y, double x_double, double slope)
+bool autonomous_car::scan_ahead_for_end_of_road(lazy_view &view, int y, double x_double, double slope)
 {
     for (int y_idx = y; y_idx >= y-10; y_idx--) {
         int x = round(x_double);
@@ -572,10 +806,8 @@ bool autonomous_car::scan_ahead_for_end_of_road(view_t &view, int y, double x_do
         assert(y_idx >= 0 && y_idx < MAX_VIEW_HEIGHT);
         assert(x-5 >= 0 && x+5 < MAX_VIEW_WIDTH);
 
-        for (int x_idx = x-5; x_idx <= x+5; x_idx++) {
-            if (view[y_idx][x_idx] == display::GREEN) {
-                return true;
-            }
+        if (view.class_bits(VIEW_GREEN, y_idx, x-5, 11) != 0) {
+            return true;
         }
         x_double += slope;
     }
@@ -583,7 +815,7 @@ bool autonomous_car::scan_ahead_for_end_of_road(view_t &view, int y, double x_do
     return false;
 }
 
-void autonomous_car::scan_ahead_for_minigap(view_t &view, int y, double x, double slope,
+void autonomous_car::scan_ahead_for_minigap(lazy_view &view, int y, double x, double slope,
                                             int &minigap_y_last, double &minigap_slope, string &minigap_type_str)
 {
     minigap_y_last = NO_VALUE;
@@ -622,7 +854,7 @@ void autonomous_car::scan_ahead_for_minigap(view_t &view, int y, double x, doubl
 }
 
 void autonomous_car::scan_ahead_for_continuing_center_lines(
-            view_t &view, int y_start, int x_start, double slope_start,
+            lazy_view &view, int y_start, int x_start, double slope_start,
             int &y_straight, int &x_straight, 
             int &y_left, int &x_left,
             int &y_right, int &x_right)
@@ -634,7 +866,6 @@ void autonomous_car::scan_ahead_for_continuing_center_lines(
         int x_last;
     } found_line[3];
     int max_found_line = 0;
-    int gen_xy_phase, x, y, r, i;
 
     // preset returns
     y_straight = NO_VALUE;
@@ -644,78 +875,80 @@ void autonomous_car::scan_ahead_for_continuing_center_lines(
     y_right = NO_VALUE;
     x_right = NO_VALUE;
 
-    // loop over expanding perimetrs
-    for (r = 7; r < 40; r++) {
-        gen_xy_phase = 0;
-        y = y_start - r;
-        x = x_start;
-
-        while (true) {
-            // generate x,y
-            if (gen_xy_phase == 0) {
-                x--;
-                if (x == x_start - r) {
-                    gen_xy_phase++;
-                }
-            } else if (gen_xy_phase == 1) {
-                y++;
-                if (y == y_start + 1) {
-                    y = y_start - r;
-                    x = x_start;
-                    gen_xy_phase++;
-                }
-            } else if (gen_xy_phase == 2) {
-                x++;
-                if (x == x_start + r) {
-                    gen_xy_phase++;
-                }
-            } else if (gen_xy_phase == 3) {
-                y++;
-                if (y == y_start + 1) {
-                    break;
-                }
-            }
-
-            // if x or y out of range then continue
-            if (x < 0 || x >= MAX_VIEW_WIDTH || y < 0 || y >= MAX_VIEW_HEIGHT) {
-                continue;
+    // add_yellow is called for each yellow pixel found, in the order the perimeter
+    // is searched; it returns true once 3 lines have been found
+    auto add_yellow = [&](int y, int x) -> bool {
+        // if this y,x is a continuation of a found line then
+        //    update the end of the found line
+        //    return
+        // endif
+        for (int i = 0; i < max_found_line; i++) {
+            if (abs(x-found_line[i].x_last) <= 3 && abs(y-found_line[i].y_last) <= 3) {
+                found_line[i].y_last = y;
+                found_line[i].x_last = x;
+                return false;
             }
+        }
 
-            // if view[y][x] not yellow then conitinue
-            if (view[y][x] != display::YELLOW) {
-                continue;
-            }
+        // found a new line, add it
+        found_line[max_found_line].y_first = y;
+        found_line[max_found_line].x_first = x;
+        found_line[max_found_line].y_last = y;
+        found_line[max_found_line].x_last = x;
+        max_found_line++;
 
-            // if this y,x is a continuation of a found line then
-            //    update the end of the found line
-            //    continue
-            // endif
-            for (i = 0; i < max_found_line; i++) {
-                if (abs(x-found_line[i].x_last) <= 3 && abs(y-found_line[i].y_last) <= 3) {
-                    found_line[i].y_last = y;
-                    found_line[i].x_last = x;
-                    break;
+        // if found 3 lines then we're done
+        return max_found_line == 3;
+    };
+
+    // scan_row checks row y from x_first to x_last, in either direction, 16 pixels
+    // at a time using the view's yellow bit masks
+    auto scan_row = [&](int y, int x_first, int x_last) -> bool {
+        int step = (x_last >= x_first ? 1 : -1);
+        int lo = std::max(std::min(x_first, x_last), 0);
+        int hi = std::min(std::max(x_first, x_last), MAX_VIEW_WIDTH-1);
+        if (y < 0 || y >= MAX_VIEW_HEIGHT || lo > hi) {
+            return false;
+        }
+        for (int piece = 0; piece <= (hi - lo) / 16; piece++) {
+            int x = (step == 1 ? lo + 16 * piece : std::max(hi - 16 * piece - 15, lo));
+            int n = (step == 1 ? std::min(16, hi - x + 1) : hi - 16 * piece - x + 1);
+            unsigned int yellow = view.class_bits(VIEW_YELLOW, y, x, n);
+            while (yellow) {
+                int b = (step == 1 ? __builtin_ctz(yellow) : 31 - __builtin_clz(yellow));
+                yellow &= ~(1u << b);
+                if (add_yellow(y, x + b)) {
+                    return true;
                 }
             }
-            if (i < max_found_line) {
-                continue;
-            }
-                    
-            // found a new line, add it
-            found_line[max_found_line].y_first = y;
-            found_line[max_found_line].x_first = x;
-            found_line[max_found_line].y_last = y;
-            found_line[max_found_line].x_last = x;
-            max_found_line++;
-
-            // if found 3 lines then we're done
-            if (max_found_line == 3) {
-                break;
-            }
         }
+        return false;
+    };
 
-        // if found 3 lines then we're done
-        if (max_found_line == 3) {
+    // scan_column checks column x from y_first down the view to y_last
+    auto scan_column = [&](int x, int y_first, int y_last) -> bool {
+        if (x < 0 || x >= MAX_VIEW_WIDTH) {
+            return false;
+        }
+        for (int y = std::max(y_first, 0); y <= std::min(y_last, MAX_VIEW_HEIGHT-1); y++) {
+            if (view(y, x) == display::YELLOW && add_yellow(y, x)) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // loop over expanding perimeters, each is searched in the order: the left half of 
+    // the top row from the center outward, the left side downward, the top center, the 
+    // right half of the top row from the center outward, and the right side downward
+    for (int r = 7; r < 40; r++) {
+        int y_top = y_start - r;
+        if (scan_row(y_top, x_start - 1, x_start - r) ||
+            scan_column(x_start - r, y_top + 1, y_start) ||
+            scan_row(y_top, x_start, x_start) ||
+            scan_row(y_top, x_start + 1, x_start + r) ||
+            scan_column(x_start + r, y_top + 1, y_start))
+        {
             break;
         }
     }
@@ -762,6 +995,37 @@ void autonomous_car::scan_ahead_for_continuing_center_lines(
     }
 }
 
+// scan_distance_needed returns how far ahead scan_road needs to find the road clear;
+// set_car_controls sets the same controls for any distance_road_is_clear beyond this
+// (the state changes only look at distances of 5 feet or less), but the distance 
+// shown on the dashboard is then a lower bound:
+// . the distance the car needs to stop at K_DESIRED_DECEL from speed v is 
+//   S = v^2 / (2*A), and set_car_controls brakes only when the road is clear for less
+//   than S at the current speed
+// . otherwise it accelerates at (desired_speed - speed) * K_ACCEL_FACTOR, limited to 
+//   MAX_SPEED_CTL, where desired_speed is the speed with stopping distance equal 
+//   to the road clear distance, limited to max speed; so the acceleration is the same 
+//   for all distances at least the stopping distance from MAX_SPEED_ACCEL_SPEED above 
+//   the current speed, or from max speed
+// . the steering target, at most half the speed in feet, is well within this
+// so a slow or stopped car scans only a short way ahead
+int autonomous_car::scan_distance_needed()
+{
+    const double MAX_SPEED_ACCEL_SPEED = MAX_SPEED_CTL / K_ACCEL_FACTOR;  // mph
+    const int    MIN_SCAN_DISTANCE = 40;  // ft
+
+    double v = get_speed() + MAX_SPEED_ACCEL_SPEED;
+    if (v > get_max_speed()) {
+        v = get_max_speed();
+    }
+    double stopping_distance = (v * v) / (2 * (-K_DESIRED_DECEL*3600)) * 5280;  // ft
+
+    // set_car_controls stops the car 5 feet before the obstruction, and 
+    // add a few feet of margin
+    int distance = stopping_distance + 5 + 5;
+    return (distance < MIN_SCAN_DISTANCE ? MIN_SCAN_DISTANCE : distance);
+}
+
 void autonomous_car::set_car_controls()
 {
     assert(distance_road_is_clear != NO_VALUE);
@@ -808,11 +1072,6 @@ void autonomous_car::set_car_controls()
     // speed control ...
     // ---------------------
 
-    // normal braking, for example to come to stop at a stop line
-    const double K_DESIRED_DECEL = MIN_SPEED_CTL * 0.33;  // mph per second
-    // control how quickly the car accelerates to a desired speed
-    const double K_ACCEL_FACTOR  = 0.5;
-
     // determine adjusted_distance_road_is_clear, which is a slightly reduced
     // distance_road_is_clear; this is used in the calculations below so
     // that the car will stop a few feet before the obstruction
@@ -923,8 +1182,8 @@ const string autonomous_car::obstruction_string(enum obstruction o)
 
 void autonomous_car::coord_convert_view_to_fixed(double y_view, double x_view, double &y_fixed, double &x_fixed)
 {
-    double cosine = cos(-get_dir() * (M_PI/180));
-    double sine   = sin(-get_dir() * (M_PI/180));
+    double cosine = dir_cos;
+    double sine   = -dir_sin;
     double x_view_rotated, y_view_rotated;
 
     y_view = MAX_VIEW_HEIGHT-1 - y_view;
@@ -939,8 +1198,8 @@ void autonomous_car::coord_convert_view_to_fixed(double y_view, double x_view, d
 
 void autonomous_car::coord_convert_fixed_to_view(double y_fixed, double x_fixed, double &y_view, double &x_view)
 {
-    double cosine = cos(get_dir() * (M_PI/180));
-    double sine   = sin(get_dir() * (M_PI/180));
+    double cosine = dir_cos;
+    double sine   = dir_sin;
     double x_view_rotated, y_view_rotated;
 
     x_view_rotated = x_fixed - get_x();
@@ -34,6 +34,9 @@ public:
     virtual void draw_dashboard(int pid);
     virtual void update_controls(double microsecs);
 
+    // far view stride: 1, 2 or 4; see lazy_view
+    static void set_far_view_stride(int stride) { far_view_stride = stride; }
+
 private:
     static const int MAX_VIEW_WIDTH = 201;
     static const int MAX_VIEW_HEIGHT = 400;
@@ -45,6 +48,68 @@ private:
     enum obstruction { OBSTRUCTION_NONE, OBSTRUCTION_STOP_LINE, OBSTRUCTION_REAR_VEHICLE, OBSTRUCTION_FRONT_VEHICLE,
                        OBSTRUCTION_END_OF_ROAD };
     typedef unsigned char (view_t)[MAX_VIEW_HEIGHT][MAX_VIEW_WIDTH];
+
+    // the front view used by update_controls, sampled from the world in chunks 
+    // of VIEW_CHUNK pixels of a row, as they are first read; scan_road reads only 
+    // a narrow band around the center line, so most of the view is never sampled
+    //
+    // for each sampled chunk the view also keeps a bit mask per pixel class, so 
+    // the scanners can test a run of up to 17 pixels of a row with class_bits
+    //
+    // with a far_view_stride above 1, the rows more than FAR_VIEW_DISTANCE ahead 
+    // of the car are grouped into cells of far_view_stride rows, and all the rows 
+    // of a cell hold the highest priority pixel of the cell's rows at each x, so 
+    // thin stop lines and vehicle edges are kept; scan_road then needs to check 
+    // only the first row of each cell
+    static const int VIEW_CHUNK = 16;
+    static const int FAR_VIEW_DISTANCE = 100;  // ft
+    static const int FAR_VIEW_Y = yo - 8 - FAR_VIEW_DISTANCE;
+    static int far_view_stride;
+    static const int VIEW_ROW_SIZE = (MAX_VIEW_WIDTH + VIEW_CHUNK - 1) / VIEW_CHUNK * VIEW_CHUNK;
+    enum view_class { VIEW_YELLOW, VIEW_GREEN, VIEW_ROAD, MAX_VIEW_CLASS };  // road is yellow or black
+    class lazy_view {
+    public:
+        lazy_view(world &world, int x, int y, double dir);
+        unsigned char operator()(int y, int x) {
+            check_sampled(y, x);
+            return pixels[y][x];
+        }
+        unsigned int class_bits(enum view_class cls, int y, int x, int n) {
+            int chunk = x / VIEW_CHUNK;
+            int last_chunk = (x + n - 1) / VIEW_CHUNK;
+            check_sampled(y, x);
+            check_sampled(y, x + n - 1);
+            unsigned int bits = cls_bits[cls][y][chunk];
+            if (last_chunk != chunk) {
+                bits |= cls_bits[cls][y][last_chunk] << VIEW_CHUNK;
+            }
+            return (bits >> (x % VIEW_CHUNK)) & ((1u << n) - 1);
+        }
+        const unsigned char * row(int y, int x, int n) {
+            check_sampled(y, x);
+            check_sampled(y, x + n - 1);
+            return &pixels[y][x];
+        }
+        void set(int y, int x, unsigned char pixel);
+        static bool same_cell(int y1, int y2) {
+            return far_view_stride > 1 && y1 <= FAR_VIEW_Y && y2 <= FAR_VIEW_Y &&
+                   (FAR_VIEW_Y - y1) / far_view_stride == (FAR_VIEW_Y - y2) / far_view_stride;
+        }
+    private:
+        world &w;
+        world::view_origin vo;
+        unsigned short valid[MAX_VIEW_HEIGHT];
+        unsigned char pixels[MAX_VIEW_HEIGHT][VIEW_ROW_SIZE];
+        unsigned short cls_bits[MAX_VIEW_CLASS][MAX_VIEW_HEIGHT][VIEW_ROW_SIZE / VIEW_CHUNK];
+
+        void check_sampled(int y, int x) {
+            if ((valid[y] & (1 << (x / VIEW_CHUNK))) == 0) {
+                sample(y, x / VIEW_CHUNK);
+            }
+        }
+        void sample(int y, int chunk);
+        void set_class_bits(int y, int chunk);
+    };
     typedef struct {
         bool valid;
         double y_start_view;
@@ -61,21 +126,42 @@ private:
     long time_in_this_state_us;
     enum obstruction obstruction;
     int distance_road_is_clear;
+    bool road_clear_beyond_scan;  // scan_road stopped at scan_distance_needed
     double x_line[MAX_VIEW_HEIGHT];
     fullgap_t fullgap;
+
+    // the center line rows that the last scan_road found by scanning, in fixed 
+    // coordinates; scan_road uses these to predict the center line in the next 
+    // view, and scans only every TRACE_VERIFY_INTERVAL'th predicted row to check 
+    // the prediction, and the rows near the end of the trace
+    static const int TRACE_VERIFY_INTERVAL = 8;
+    static const int TRACE_END_ROWS = 5;
+    int trace_len;
+    enum state trace_state;
+    double trace_y_fixed[MAX_VIEW_HEIGHT];
+    double trace_x_fixed[MAX_VIEW_HEIGHT];
+    double dir_cos;
+    double dir_sin;
     bool continuing_from_stop_left_is_possible;
     bool continuing_from_stop_straight_is_possible;
     bool continuing_from_stop_right_is_possible;
 
-    void scan_road(view_t & view);
-    double scan_across_for_center_line(view_t &view, int y, double x);
-    enum obstruction scan_across_for_obstruction(view_t &view, int y, double x);
-    bool scan_ahead_for_end_of_road(view_t &view, int y, double x, double slope);
-    void scan_ahead_for_minigap(view_t &view, int y, double x, double slope,
+    void scan_road(lazy_view &view);
+    void predict_x_line(double x_predicted[MAX_VIEW_HEIGHT]);
+    double scan_across_for_center_line(lazy_view &view, int y, double x);
+    enum obstruction scan_across_for_obstruction(lazy_view &view, int y, double x);
+    bool scan_ahead_for_end_of_road(lazy_view &view, int y, double x, double slope);
+    void scan_ahead_for_minigap(lazy_view &view, int y, double x, double slope,
             int &minigap_y_last, double &minigap_slope, string &minigap_type_str);
-    void scan_ahead_for_continuing_center_lines(view_t &view, int y, int x, double slope,
+    void scan_ahead_for_continuing_center_lines(lazy_view &view, int y, int x, double slope,
             int &y_straight, int &x_straight, int &y_left, int &x_left, int &y_right, int &x_right);
 
+    // normal braking, for example to come to stop at a stop line
+    const double K_DESIRED_DECEL = MIN_SPEED_CTL * 0.33;  // mph per second
+    // control how quickly the car accelerates to a desired speed
+    const double K_ACCEL_FACTOR  = 0.5;
+
+    int scan_distance_needed();
     void set_car_controls();
 
     void state_change(enum state new_state);
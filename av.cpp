@@ -24,7 +24,9 @@ SOFTWARE.
 #include <thread>
 #include <atomic>
 #include <condition_variable>
-#include <random>
+#include <cmath>
+#include <vector>
+#include <unordered_map>
 
 #include <unistd.h>  // for getopt
 
@@ -70,29 +72,50 @@ using std::istringstream;
 #define PANE_PGM_CTL_HEIGHT         180
 
 // world display pane center coordinates and zoom
-double       center_x = world::WORLD_WIDTH / 2;
-double       center_y = world::WORLD_HEIGHT / 2;
+double       center_x;
+double       center_y;
 const double ZOOM_FACTOR = 1.1892071;
 const double MAX_ZOOM    = 256.0 - .01;
 const double MIN_ZOOM    = (1.0 / ZOOM_FACTOR) + .01;
 double       zoom = 1.0;
 
-// simulation cycle time
-const int CYCLE_TIME_US = 50000;  // 50 ms
+// simulation rates
+//   the car mechanics are integrated physics_hz times a second of simulated time,
+//   the car controls are updated every control_steps physics steps, and the display 
+//   is updated render_hz times a second; in turbo mode each display update is 
+//   preceded by as many control periods as fit in the render period
+int  physics_hz = 200;
+int  control_hz = 20;
+int  render_hz  = 20;
+long physics_step = 0;
+void place_all_cars(world &w);
+void update_all_car_controls(double microsecs);
 
 // cars
-const int     MAX_CAR = 300; 
-class car   * car[MAX_CAR];
-int           dashboard_and_view_idx = -1;
+//   cars holds the live cars, packed, so that loops over the cars only visit live
+//   ones; car_idx gives the index in cars of the car with a given id. a car's id
+//   stays the same for the life of the car, but its index doesn't, as a car is
+//   deleted by moving the last car into its place. 
+const int     MAX_CAR = 100000; 
+std::vector<class car *> cars;
+std::unordered_map<int,int> car_idx;
+int           dashboard_and_view_id = -1;
 int           launch_pending = 0;
 bool launch_new_car(display &d, world &w);
-int get_next_dashboard_and_view_idx(int id);
+class car * find_car(int id);
+void delete_car(int id);
+int get_next_dashboard_and_view_id(int id);
 
 // update car controls threads
+//   each round the threads update the controls of cars[0] to 
+//   cars[car_update_controls_count-1] between them
 const int          MAX_CAR_UPDATE_CONTROLS_THREAD = 10;
 bool               car_update_controls_terminate = false;
+int                car_update_controls_round = 0;
+int                car_update_controls_count = 0;
+double             car_update_controls_microsecs = 0;
 atomic<int>        car_update_controls_idx(0);
-atomic<int>        car_update_controls_completed(0); 
+int                car_update_controls_threads_done = 0; 
 condition_variable car_update_controls_cv1;
 mutex              car_update_controls_cv1_mtx;
 condition_variable car_update_controls_cv2;
@@ -109,8 +132,12 @@ int main(int argc, char **argv)
     //
 
     // get options, and args
+    int world_width = world::WORLD_WIDTH;
+    int world_height = world::WORLD_HEIGHT;
+    uint64_t random_seed = 0;
+    bool random_seed_set = false;
     while (true) {
-        char opt_char = getopt(argc, argv, "n:");
+        char opt_char = getopt(argc, argv, "n:tc:l:w:r:s:f:");
         if (opt_char == -1) {
             break;
         }
@@ -123,10 +150,81 @@ int main(int argc, char **argv)
                 return 1;
             }
             break; }
+        case 't':
+            world::set_get_view_engine(world::GET_VIEW_TABLE);
+            break;
+        case 'c': {
+            string sampling(optarg);
+            if (sampling == "nearest") {
+                world::set_get_view_sampling(world::GET_VIEW_NEAREST);
+            } else if (sampling == "bilinear") {
+                world::set_get_view_sampling(world::GET_VIEW_BILINEAR);
+            } else {
+                ERROR("invalid view sampling '" << sampling << "', expected nearest or bilinear" << endl);
+                return 1;
+            }
+            break; }
+        case 'l': {
+            string layout(optarg);
+            if (layout == "linear") {
+                world::set_world_layout(world::WORLD_LINEAR);
+            } else if (layout == "tiled") {
+                world::set_world_layout(world::WORLD_TILED);
+            } else {
+                ERROR("invalid world layout '" << layout << "', expected linear or tiled" << endl);
+                return 1;
+            }
+            break; }
+        case 'w': {
+            istringstream s(optarg);
+            char x_char = 0;
+            s >> world_width >> x_char >> world_height;
+            if (s.fail() || !s.eof() || x_char != 'x' || !world::valid_world_size(world_width, world_height)) {
+                ERROR("invalid world size '" << s.str() << "', expected WIDTHxHEIGHT, multiples of 64 up to 65536" << endl);
+                return 1;
+            }
+            break; }
+        case 'r': {
+            istringstream s(optarg);
+            char colon1_char = 0, colon2_char = 0;
+            s >> physics_hz >> colon1_char >> control_hz >> colon2_char >> render_hz;
+            if (s.fail() || !s.eof() || colon1_char != ':' || colon2_char != ':' ||
+                physics_hz < 1 || physics_hz > 10000 || render_hz < 1 || render_hz > 1000 ||
+                control_hz < 1 || control_hz > physics_hz || physics_hz % control_hz != 0) 
+            {
+                ERROR("invalid rates '" << s.str() << "', expected PHYSICS_HZ:CONTROL_HZ:RENDER_HZ, " <<
+                      "with CONTROL_HZ dividing PHYSICS_HZ" << endl);
+                return 1;
+            }
+            break; }
+        case 's': {
+            istringstream s(optarg);
+            s >> random_seed;
+            if (s.fail() || !s.eof()) {
+                ERROR("invalid random seed '" << s.str() << "'" << endl);
+                return 1;
+            }
+            random_seed_set = true;
+            break; }
+        case 'f': {
+            istringstream s(optarg);
+            int stride;
+            s >> stride;
+            if (s.fail() || !s.eof() || (stride != 1 && stride != 2 && stride != 4)) {
+                ERROR("invalid far view stride '" << s.str() << "', expected 1, 2 or 4" << endl);
+                return 1;
+            }
+            autonomous_car::set_far_view_stride(stride);
+            break; }
         default:
             return 1;
         }
     }
+    if (!random_seed_set) {
+        random_seed = microsec_timer();
+    }
+    INFO("random seed " << random_seed << endl);
+    car::set_random_seed(random_seed);
     string filename = "world.dat";
     if ((argc - optind) >= 1) {
         filename = argv[optind];
@@ -140,15 +238,16 @@ int main(int argc, char **argv)
     car::static_init(d);
 
     // create the world
-    world w(d);
+    world w(d, world_width, world_height);
     bool success = w.read(filename);
     if (!success) {
         ERROR("read " << filename << endl);
         return 1;
     }
+    center_x = w.get_width() / 2;
+    center_y = w.get_height() / 2;
 
     // create threads to update car controls
-    car_update_controls_idx = MAX_CAR;
     for (int i = 0; i < MAX_CAR_UPDATE_CONTROLS_THREAD; i++) {
         car_update_controls_thread_id[i] = thread(car_update_controls_thread, i);
     }
@@ -162,6 +261,11 @@ int main(int argc, char **argv)
     bool       turbo = false;
     bool       done = false;
 
+    const double physics_period_us = 1000000. / physics_hz;
+    const int    control_steps     = physics_hz / control_hz;
+    const long   render_period_us  = 1000000 / render_hz;
+    long         step_credit       = 0;
+
     while (!done) {
         //
         // STORE THE START TIME
@@ -178,37 +282,41 @@ int main(int argc, char **argv)
             launch_pending--;
         }
 
-        // update all car mechanics: position, direction, speed
-        if (mode == RUN || mode == STEP) {            
-            for (int i = 0; i < MAX_CAR; i++) {
-                if (car[i] == NULL) {
-                    continue;
-                }
-                car[i]->update_mechanics(CYCLE_TIME_US);
+        // advance the simulation; outside of turbo mode the number of physics steps
+        // is the number that keeps simulated time in step with real time
+        if (mode == RUN || mode == STEP) {
+            long steps;
+            if (mode == STEP || turbo) {
+                steps = control_steps;
+            } else {
+                step_credit += physics_hz;
+                steps = step_credit / render_hz;
+                step_credit %= render_hz;
             }
-        }
 
-        // update car positions in the world 
-        w.place_object_init();
-        for (int i = 0; i < MAX_CAR; i++) {
-            if (car[i] == NULL) {
-                continue;
-            }
-            car[i]->place_car_in_world();
-        }
+            while (true) {
+                for (long i = 0; i < steps; i++) {
+                    // update all car controls: steering and speed
+                    if (physics_step % control_steps == 0) {
+                        place_all_cars(w);
+                        update_all_car_controls(control_steps * physics_period_us);
+                    }
+
+                    // update all car mechanics: position, direction, speed
+                    car::update_all_mechanics(physics_period_us);
+                    physics_step++;
+                }
 
-        // update all car controls: steering and speed
-        if (mode == RUN || mode == STEP) {            
-            std::unique_lock<std::mutex> car_update_controls_cv2_lck(car_update_controls_cv2_mtx);
-            car_update_controls_completed = 0;
-            car_update_controls_idx = 0;
-            car_update_controls_cv1.notify_all();
-            while (car_update_controls_completed != MAX_CAR) {
-                car_update_controls_cv2.wait(car_update_controls_cv2_lck);
+                // in turbo mode keep going while there is time left in the render period
+                if (mode != RUN || !turbo || microsec_timer() - start_time_us >= render_period_us) {
+                    break;
+                }
             }
-            car_update_controls_cv2_lck.unlock(); // not needed, unique_lock automatically unlocks
         }
 
+        // update car positions in the world 
+        place_all_cars(w);
+
         //
         // DISPLAY UPDATE 
         // 
@@ -219,31 +327,29 @@ int main(int argc, char **argv)
                 PANE_CAR_DASHBOARD_X, PANE_CAR_DASHBOARD_Y, PANE_CAR_DASHBOARD_WIDTH, PANE_CAR_DASHBOARD_HEIGHT,
                 PANE_PGM_CTL_X,       PANE_PGM_CTL_Y,       PANE_PGM_CTL_WIDTH,       PANE_PGM_CTL_HEIGHT);
 
-        // draw world 
-        w.draw(PANE_WORLD_ID,center_x,center_y,zoom);
+        // draw world; not while minimized, as there would be nothing to see
+        if (!d.get_win_minimized()) {
+            w.draw(PANE_WORLD_ID,center_x,center_y,zoom);
+        }
 
         // draw car front view and dashboard
-        if (dashboard_and_view_idx != -1) {
-            car[dashboard_and_view_idx]->draw_view(PANE_CAR_VIEW_ID);
-            car[dashboard_and_view_idx]->draw_dashboard(PANE_CAR_DASHBOARD_ID);
+        if (dashboard_and_view_id != -1) {
+            find_car(dashboard_and_view_id)->draw_view(PANE_CAR_VIEW_ID);
+            find_car(dashboard_and_view_id)->draw_dashboard(PANE_CAR_DASHBOARD_ID);
         }
 
         // draw pointers to all cars 
-        for (int i = 0; i < MAX_CAR; i++) {
-            if (car[i] == NULL) {
-                continue;
-            }
-
+        for (auto c : cars) {
             double pixel_x, pixel_y;
             int ptr_size = 3 * zoom;
             if (ptr_size < 7) {
                 ptr_size = 7;
             }
             enum display::color color;
-            color = (i == dashboard_and_view_idx ? display::WHITE :
-                     car[i]->get_failed()        ? display::PINK :
-                                                   display::PURPLE);
-            w.cvt_coord_world_to_pixel(car[i]->get_x(), car[i]->get_y(), pixel_x, pixel_y);
+            color = (c->get_id() == dashboard_and_view_id ? display::WHITE :
+                     c->get_failed()                      ? display::PINK :
+                                                            display::PURPLE);
+            w.cvt_coord_world_to_pixel(c->get_x(), c->get_y(), pixel_x, pixel_y);
             d.draw_set_color(color);
             d.draw_pointer(pixel_x*PANE_WORLD_WIDTH, pixel_y*PANE_WORLD_HEIGHT, ptr_size, PANE_WORLD_ID);
         }
@@ -275,11 +381,8 @@ int main(int argc, char **argv)
         // display number cars: active, failed, and pending
         int failed_count = 0;
         int active_count = 0;
-        for (int i = 0; i < MAX_CAR; i++) {
-            if (car[i] == NULL) {
-                continue;
-            }
-            if (!car[i]->get_failed()) {
+        for (auto c : cars) {
+            if (!c->get_failed()) {
                 active_count++;
             } else {
                 failed_count++;
@@ -346,11 +449,10 @@ int main(int argc, char **argv)
                 break;
             }
             if (event.eid == eid_delete) {
-                if (dashboard_and_view_idx != -1) {
-                    int id = car[dashboard_and_view_idx]->get_id();
-                    delete car[dashboard_and_view_idx];
-                    car[dashboard_and_view_idx] = NULL;
-                    dashboard_and_view_idx = get_next_dashboard_and_view_idx(id);
+                if (dashboard_and_view_id != -1) {
+                    int id = dashboard_and_view_id;
+                    delete_car(id);
+                    dashboard_and_view_id = get_next_dashboard_and_view_id(id);
                 }
                 d.event_play_sound();
                 break;
@@ -370,16 +472,13 @@ int main(int argc, char **argv)
                 w.cvt_coord_pixel_to_world((double)event.click.x/PANE_WORLD_WIDTH,
                                            (double)event.click.y/PANE_WORLD_HEIGHT,
                                            x, y);
-                for (int i = 0; i < MAX_CAR; i++) {
-                    if (car[i] == NULL) {
-                        continue;
-                    }
-                    if (x >= car[i]->get_x() - 7 &&
-                        x <= car[i]->get_x() + 7 &&
-                        y >= car[i]->get_y() - 7 &&
-                        y <= car[i]->get_y() + 7)
+                for (auto c : cars) {
+                    if (x >= c->get_x() - 7 &&
+                        x <= c->get_x() + 7 &&
+                        y >= c->get_y() - 7 &&
+                        y <= c->get_y() + 7)
                     {
-                        dashboard_and_view_idx = i;
+                        dashboard_and_view_id = c->get_id();
                         d.event_play_sound();
                         break;
                     }
@@ -387,10 +486,8 @@ int main(int argc, char **argv)
                 break;
             }
             if (event.eid == eid_vp_click || event.eid == eid_dp_click) {
-                int id = (dashboard_and_view_idx != -1
-                          ? car[dashboard_and_view_idx]->get_id()
-                          : 0);
-                dashboard_and_view_idx = get_next_dashboard_and_view_idx(id);
+                int id = (dashboard_and_view_id != -1 ? dashboard_and_view_id : 0);
+                dashboard_and_view_id = get_next_dashboard_and_view_id(id);
                 d.event_play_sound();
                 break;
             }
@@ -400,21 +497,18 @@ int main(int argc, char **argv)
         // DELAY TO COMPLETE THE TARGET CYCLE TIME
         //
 
-        // if not in turbo then 
-        //   delay to complete CYCLE_TIME_US, except
-        // endif
+        // delay to complete the render period; in turbo mode the simulation 
+        // has already used up the render period
         long end_time_us = microsec_timer();
-        if (!turbo) {
-            long delay_us = CYCLE_TIME_US - (end_time_us - start_time_us);
-            microsec_sleep(delay_us);
-        }
+        long delay_us = render_period_us - (end_time_us - start_time_us);
+        microsec_sleep(delay_us);
 
-        // if processng time exceeds cycle time then print warning
+        // if processng time exceeds the render period then print warning
         static long time_of_last_processing_time_warning;
-        if (end_time_us - start_time_us > CYCLE_TIME_US &&
+        if (!turbo && end_time_us - start_time_us > render_period_us &&
             microsec_timer() - time_of_last_processing_time_warning > 10000000) 
         {
-            WARNING("processing time " <<  end_time_us-start_time_us << " exceeds cycle time " << CYCLE_TIME_US << endl);
+            WARNING("processing time " <<  end_time_us-start_time_us << " exceeds render period " << render_period_us << endl);
             time_of_last_processing_time_warning = microsec_timer();
         }
     }
@@ -423,7 +517,9 @@ int main(int argc, char **argv)
     // TERMINATE CAR_UPDATE_CONTROLS_THREADS   
     //
 
+    car_update_controls_cv1_mtx.lock();
     car_update_controls_terminate = true;
+    car_update_controls_cv1_mtx.unlock();
     car_update_controls_cv1.notify_all();
     for (auto& th : car_update_controls_thread_id) {
         th.join();
@@ -436,87 +532,154 @@ int main(int argc, char **argv)
 
 bool launch_new_car(display &d, world &w)
 {
-    const int xo = 2055;
-    const int yo = 2048;
-    const int dir = 0;
-    const int speed = 0;
-
-    // check for clear to launch
-    for (int y = yo; y >= yo-12; y--) {
-        if (w.get_world_pixel(xo,y) != display::BLACK) {
-            return false;
-        }
+    // check for room for another car
+    if ((int)cars.size() == MAX_CAR) {
+        return false;
     }
 
-    // find a free slot in car array
-    int idx;
-    for (idx = 0; idx < MAX_CAR; idx++) {
-        if (car[idx] == NULL) {
-            break;
+    // cars are launched from the world's launch points in turn, skipping points 
+    // that aren't clear; worlds without launch points use the launch point near 
+    // the center of the original world
+    static const struct world::launch_point default_launch_point = { 2055, 2048, 0 };
+    static unsigned int launch_point_idx;
+    const std::vector<struct world::launch_point> &launch_points = w.get_launch_points();
+    const struct world::launch_point * lp = NULL;
+    int num_launch_points = (launch_points.empty() ? 1 : launch_points.size());
+    for (int i = 0; i < num_launch_points && lp == NULL; i++) {
+        const struct world::launch_point &candidate = (launch_points.empty() 
+                ? default_launch_point 
+                : launch_points[(launch_point_idx + i) % launch_points.size()]);
+
+        // check for clear to launch
+        bool clear = true;
+        for (int j = 0; j <= 12 && clear; j++) {
+            clear = (w.get_world_pixel(candidate.x + j * sin(candidate.dir*(M_PI/180.0)), 
+                                       candidate.y - j * cos(candidate.dir*(M_PI/180.0))) == display::BLACK);
+        }
+        if (clear) {
+            lp = &candidate;
+            launch_point_idx += i + 1;
         }
     }
-    if (idx == MAX_CAR) {
+    if (lp == NULL) {
         return false;
     }
-
-    // choose the car's max speed at random, in range 30 to 50 mph
-    static std::default_random_engine generator(microsec_timer()); 
-    static std::uniform_int_distribution<int> random_uniform_30_to_50(30,50);
-    int max_speed = random_uniform_30_to_50(generator);
+    const int xo = lp->x;
+    const int yo = lp->y;
+    const int dir = lp->dir;
+    const int speed = 0;
 
     // choose the car's id
     static int id;
     id++;
 
+    // choose the car's max speed at random, in range 30 to 50 mph; the random stream
+    // is keyed by the car's id, above the range of stream numbers used by the cars 
+    // themselves, so the car gets the same max speed on every run with the same seed
+    random_stream random(car::get_random_seed(), 0x100000000ULL + id);
+    int max_speed = random.uniform_int(30,50);
+
     // create the car
-    car[idx] = new class autonomous_car(d, w, id, xo, yo, dir, speed, max_speed);
+    car_idx[id] = cars.size();
+    cars.push_back(new class autonomous_car(d, w, id, xo, yo, dir, speed, max_speed));
 
     // if dashboard display is not active then display this car
-    if (dashboard_and_view_idx == -1) {
-        dashboard_and_view_idx = idx;
+    if (dashboard_and_view_id == -1) {
+        dashboard_and_view_id = id;
     }
 
     // return success
     return true;
 }
 
-// -----------------  GET NEXT DASHBOARD AND VIEW IDX  ---------------------------------------------
+// -----------------  PLACE ALL CARS  --------------------------------------------------------------
 
-int get_next_dashboard_and_view_idx(int id_arg)
+void place_all_cars(world &w)
 {
-    int min_id_idx = -1;
-    int min_id_greater_than_id_arg_idx = -1;
-    int min_id = 99999999;
-    int min_id_greater_than_id_arg = 99999999;
-
-    // loop over all possible cars
-    for (int idx = 0; idx < MAX_CAR; idx++) {
-        // if car doesn't exist then continue
-        if (car[idx] == NULL) {
-            continue;
-        }
+    w.place_object_init();
+    for (auto c : cars) {
+        c->place_car_in_world();
+    }
+}
+
+// -----------------  UPDATE ALL CAR CONTROLS  -----------------------------------------------------
+
+// the car controls are updated by the car update controls threads; this returns when 
+// they have all finished
+void update_all_car_controls(double microsecs)
+{
+    if (cars.empty()) {
+        return;
+    }
+
+    car_update_controls_cv1_mtx.lock();
+    car_update_controls_count = cars.size();
+    car_update_controls_microsecs = microsecs;
+    car_update_controls_idx = 0;
+    car_update_controls_threads_done = 0;
+    car_update_controls_round++;
+    car_update_controls_cv1_mtx.unlock();
+    car_update_controls_cv1.notify_all();
+
+    std::unique_lock<std::mutex> car_update_controls_cv2_lck(car_update_controls_cv2_mtx);
+    while (car_update_controls_threads_done != MAX_CAR_UPDATE_CONTROLS_THREAD) {
+        car_update_controls_cv2.wait(car_update_controls_cv2_lck);
+    }
+}
+
+// -----------------  FIND AND DELETE CAR  ---------------------------------------------------------
+
+class car * find_car(int id)
+{
+    auto it = car_idx.find(id);
+    return (it != car_idx.end() ? cars[it->second] : NULL);
+}
+
+void delete_car(int id)
+{
+    auto it = car_idx.find(id);
+    if (it == car_idx.end()) {
+        return;
+    }
+
+    // move the last car into the deleted car's place
+    int idx = it->second;
+    class car * c = cars[idx];
+    cars[idx] = cars.back();
+    car_idx[cars[idx]->get_id()] = idx;
+    cars.pop_back();
+    car_idx.erase(id);
+    delete c;
+}
+
+// -----------------  GET NEXT DASHBOARD AND VIEW ID  ----------------------------------------------
 
+int get_next_dashboard_and_view_id(int id_arg)
+{
+    int min_id = -1;
+    int min_id_greater_than_id_arg = -1;
+
+    // loop over all cars
+    for (auto c : cars) {
         // get car's id
-        int id = car[idx]->get_id();
+        int id = c->get_id();
 
         // save the minimum car id
-        if (id < min_id) {
+        if (min_id == -1 || id < min_id) {
             min_id = id;
-            min_id_idx = idx;
         }
 
         // save the minimum car id that is greater than id_arg
-        if (id > id_arg && id < min_id_greater_than_id_arg) {
+        if (id > id_arg && (min_id_greater_than_id_arg == -1 || id < min_id_greater_than_id_arg)) {
             min_id_greater_than_id_arg = id;
-            min_id_greater_than_id_arg_idx = idx;
         }
     }
 
     // return the minimum car id that is greater than id arg, if that exists, 
     // else return the minimum car id; if there are no cars then -1 is returned
-    return (min_id_greater_than_id_arg_idx != -1 
-            ? min_id_greater_than_id_arg_idx
-            : min_id_idx);
+    return (min_id_greater_than_id_arg != -1 
+            ? min_id_greater_than_id_arg
+            : min_id);
 }
         
 // -----------------  CAR UPDATE CONTROLS THREAD----------------------------------------------------
@@ -524,13 +687,17 @@ int get_next_dashboard_and_view_idx(int id_arg)
 void car_update_controls_thread(int id) 
 {
     int idx;
+    int round = 0;
 
     while (true) {
-        // wait for request
+        // wait for the next round
         std::unique_lock<std::mutex> car_update_controls_cv1_lck(car_update_controls_cv1_mtx);
-        while (car_update_controls_idx >= MAX_CAR && !car_update_controls_terminate) {
+        while (car_update_controls_round == round && !car_update_controls_terminate) {
             car_update_controls_cv1.wait(car_update_controls_cv1_lck);
         }
+        round = car_update_controls_round;
+        int count = car_update_controls_count;
+        double microsecs = car_update_controls_microsecs;
         car_update_controls_cv1_lck.unlock();
 
         // if terminate requested then break
@@ -539,18 +706,15 @@ void car_update_controls_thread(int id)
         }
 
         // update car controls
-        while ((idx = car_update_controls_idx.fetch_add(1)) < MAX_CAR) {
-            if (car[idx] != NULL) {
-                car[idx]->update_controls(CYCLE_TIME_US);
-            }
-            car_update_controls_completed++;
+        while ((idx = car_update_controls_idx.fetch_add(1)) < count) {
+            cars[idx]->update_controls(microsecs);
         }
 
-        // if this thread finished up the work then notify main that we're done
-        if (car_update_controls_completed == MAX_CAR) {
-            car_update_controls_cv2_mtx.lock();
+        // if this is the last thread to finish the round then notify main that we're done
+        car_update_controls_cv2_mtx.lock();
+        if (++car_update_controls_threads_done == MAX_CAR_UPDATE_CONTROLS_THREAD) {
             car_update_controls_cv2.notify_one();
-            car_update_controls_cv2_mtx.unlock();
         }
+        car_update_controls_cv2_mtx.unlock();
     }
 }
@@ -26,6 +26,10 @@ SOFTWARE.
 #include <cmath>
 #include <cstring>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "car.h"
 #include "logging.h"
 #include "utils.h"
@@ -41,6 +45,7 @@ const int CAR_PIXELS_HEIGHT = 17;
 const int CAR_PIXELS_WIDTH  = 17;
 unsigned char good_car_pixels[360][CAR_PIXELS_HEIGHT][CAR_PIXELS_WIDTH];
 unsigned char failed_car_pixels[360][CAR_PIXELS_HEIGHT][CAR_PIXELS_WIDTH];
+unsigned char car_pixels_mask[360][CAR_PIXELS_HEIGHT][CAR_PIXELS_WIDTH];
 
 // -----------------  CAR CLASS STATIC INITIALIZATION  ------------------------------
 
@@ -120,34 +125,44 @@ void car::static_init(display &d)
             }
         }
     }
+
+    // create car_pixels_mask, which world::place_object uses to draw the car's non 
+    // transparent pixels; good and failed cars have the same shape, so they share it
+    for (int dir = 0; dir <= 359; dir++) {
+        for (int y = 0; y < CAR_PIXELS_HEIGHT; y++) {
+            for (int x = 0; x < CAR_PIXELS_WIDTH; x++) {
+                car_pixels_mask[dir][y][x] = (good_car_pixels[dir][y][x] != display::TRANSPARENT ? 0xff : 0);
+            }
+        }
+    }
 }
 
 // -----------------  CONSTRUCTOR / DESTRUCTOR  -------------------------------------
 
 car::car(display &display, world &world, int id_arg, double x_arg, double y_arg, double dir_arg, double speed_arg, double max_speed_arg) 
-    : d(display), w(world)
+    : d(display), w(world), random(random_seed, id_arg)
 {
+    row                = state.add_row(this);
     id                 = id_arg;  
-    x                  = x_arg;
-    y                  = y_arg;
-    dir                = dir_arg;
-    speed              = speed_arg;
-    max_speed          = max_speed_arg;
-    speed_ctl          = 0;
     speed_ctl_smoothed = 0;
-    steer_ctl          = 0;
     steer_ctl_smoothed = 0;
-    failed             = false;
     failed_str         = "";
-    run_time_us        = 0;
 
-    sanitize_direction(dir);
-
-    if (x < 0 || x >= world::WORLD_WIDTH ||
-        y < 0 || y >= world::WORLD_HEIGHT ||
-        dir < 0 || dir >= 360 ||
-        speed < 0 || speed > max_speed ||
-        max_speed <= 0 || max_speed > 60)
+    state.x[row]           = x_arg;
+    state.y[row]           = y_arg;
+    state.dir[row]         = dir_arg;
+    state.speed[row]       = speed_arg;
+    state.max_speed[row]   = max_speed_arg;
+    state.speed_ctl[row]   = 0;
+    state.steer_ctl[row]   = 0;
+    state.run_time_us[row] = 0;
+    state.failed[row]      = false;
+
+    if (x_arg < 0 || x_arg >= w.get_width() ||
+        y_arg < 0 || y_arg >= w.get_height() ||
+        dir_arg < 0 || dir_arg >= 360 ||
+        speed_arg < 0 || speed_arg > max_speed_arg ||
+        max_speed_arg <= 0 || max_speed_arg > 60)
     {
         set_failed("INVALID_PARAM");
     }
@@ -155,6 +170,58 @@ car::car(display &display, world &world, int id_arg, double x_arg, double y_arg,
 
 car::~car()
 {
+    state.remove_row(row);
+}
+
+// -----------------  CAR STATE ROWS  -----------------------------------------------
+
+car_state car::state;
+uint64_t car::random_seed;
+
+int car_state::add_row(class car *c)
+{
+    owner.push_back(c);
+    x.push_back(0);
+    y.push_back(0);
+    dir.push_back(0);
+    speed.push_back(0);
+    max_speed.push_back(0);
+    speed_ctl.push_back(0);
+    steer_ctl.push_back(0);
+    run_time_us.push_back(0);
+    failed.push_back(false);
+    return owner.size() - 1;
+}
+
+void car_state::remove_row(int row)
+{
+    int last = owner.size() - 1;
+
+    // move the last row into the removed row's place
+    if (row != last) {
+        owner[row]       = owner[last];
+        x[row]           = x[last];
+        y[row]           = y[last];
+        dir[row]         = dir[last];
+        speed[row]       = speed[last];
+        max_speed[row]   = max_speed[last];
+        speed_ctl[row]   = speed_ctl[last];
+        steer_ctl[row]   = steer_ctl[last];
+        run_time_us[row] = run_time_us[last];
+        failed[row]      = failed[last];
+        owner[row]->row  = row;
+    }
+
+    owner.pop_back();
+    x.pop_back();
+    y.pop_back();
+    dir.pop_back();
+    speed.pop_back();
+    max_speed.pop_back();
+    speed_ctl.pop_back();
+    steer_ctl.pop_back();
+    run_time_us.pop_back();
+    failed.pop_back();
 }
 
 // -----------------  UPDATE CAR CONTROLS  ------------------------------------------
@@ -165,6 +232,7 @@ void car::set_steer_ctl(double val)
         return;
     }
 
+    double &steer_ctl = state.steer_ctl[row];
     if (val > MAX_STEER_CTL) {
         steer_ctl = MAX_STEER_CTL;
     } else if (val < MIN_STEER_CTL) {
@@ -180,6 +248,7 @@ void car::set_speed_ctl(double val)
         return;
     }
 
+    double &speed_ctl = state.speed_ctl[row];
     if (speed_ctl > MAX_SPEED_CTL) {
         speed_ctl = MAX_SPEED_CTL;
     } else if (speed_ctl < MIN_SPEED_CTL) {
@@ -198,57 +267,215 @@ void car::set_speed_ctl(double val)
 // - steer_ctl: degrees
 // - speed_ctl: mph/sec
 
-void car::update_mechanics(double microsecs)
+// update_rows applies one step of the mechanics to rows first..last-1 of state. 
+// the sin, cos and atan are evaluated with polynomials, the same operations in 
+// the same order in the scalar and SSE2 code, so both give identical results.
+//
+// sin and cos of dir are found by reducing dir to r = dir - 90q, |r| <= 45 degrees, 
+// and then swapping and negating sin(r) and cos(r) according to the quadrant q:
+//   q         0     1     2     3
+//   sin(dir)  s     c    -s    -c
+//   cos(dir)  c    -s    -c     s
+// the original formulation moves the car by cos(dir+270) and sin(dir+270), which 
+// are sin(dir) and -cos(dir).
+
+const double WHEEL_BASE_LENGTH = 10;  // ft 
+const double DEG2RAD = M_PI / 180.;
+const double RAD2DEG = 180. / M_PI;
+
+// sin and cos of r radians, |r| <= pi/4
+static inline void sincos_poly(double r, double &s, double &c)
+{
+    double r2 = r * r;
+    s = r * (1 + r2*(-1/6. + r2*(1/120. + r2*(-1/5040. + r2*(1/362880. + 
+             r2*(-1/39916800. + r2*(1/6227020800.)))))));
+    c = 1 + r2*(-1/2. + r2*(1/24. + r2*(-1/720. + r2*(1/40320. + r2*(-1/3628800. + 
+             r2*(1/479001600. + r2*(-1/87178291200.)))))));
+}
+
+// atan of t radians; two half angle reductions bring the argument below tan(pi/16)
+static inline double atan_poly(double t)
 {
-    const double WHEEL_BASE_LENGTH = 10;  // ft 
+    double u = t / (1 + sqrt(1 + t*t));
+    u = u / (1 + sqrt(1 + u*u));
+    double u2 = u * u;
+    return 4 * u * (1 + u2*(-1/3. + u2*(1/5. + u2*(-1/7. + u2*(1/9. + u2*(-1/11. + u2*(1/13.)))))));
+}
+
+static void update_rows(car_state &st, int first, int last, double microsecs)
+{
+    const double distance_factor = microsecs * (5280./3600./1e6);
+    const double delta_speed_factor = microsecs / 1000000.;
+    int i = first;
+
+#if defined(__SSE2__)
+    const __m128d zero      = _mm_setzero_pd();
+    const __m128d one       = _mm_set1_pd(1);
+    const __m128d sign      = _mm_set1_pd(-0.0);
+    const __m128i one_i     = _mm_set1_epi32(1);
+    const __m128i two_i     = _mm_set1_epi32(2);
+
+    // sin(r), cos(r) of r radians, |r| <= pi/4
+    auto sincos_pd = [&](__m128d r, __m128d &s, __m128d &c) {
+        __m128d r2 = _mm_mul_pd(r, r);
+        __m128d p = _mm_set1_pd(1/6227020800.);
+        p = _mm_add_pd(_mm_set1_pd(-1/39916800.), _mm_mul_pd(r2, p));
+        p = _mm_add_pd(_mm_set1_pd(1/362880.), _mm_mul_pd(r2, p));
+        p = _mm_add_pd(_mm_set1_pd(-1/5040.), _mm_mul_pd(r2, p));
+        p = _mm_add_pd(_mm_set1_pd(1/120.), _mm_mul_pd(r2, p));
+        p = _mm_add_pd(_mm_set1_pd(-1/6.), _mm_mul_pd(r2, p));
+        p = _mm_add_pd(one, _mm_mul_pd(r2, p));
+        s = _mm_mul_pd(r, p);
+        __m128d q = _mm_set1_pd(-1/87178291200.);
+        q = _mm_add_pd(_mm_set1_pd(1/479001600.), _mm_mul_pd(r2, q));
+        q = _mm_add_pd(_mm_set1_pd(-1/3628800.), _mm_mul_pd(r2, q));
+        q = _mm_add_pd(_mm_set1_pd(1/40320.), _mm_mul_pd(r2, q));
+        q = _mm_add_pd(_mm_set1_pd(-1/720.), _mm_mul_pd(r2, q));
+        q = _mm_add_pd(_mm_set1_pd(1/24.), _mm_mul_pd(r2, q));
+        q = _mm_add_pd(_mm_set1_pd(-1/2.), _mm_mul_pd(r2, q));
+        c = _mm_add_pd(one, _mm_mul_pd(r2, q));
+    };
+    auto half_angle_pd = [&](__m128d t) {
+        return _mm_div_pd(t, _mm_add_pd(one, _mm_sqrt_pd(_mm_add_pd(one, _mm_mul_pd(t, t)))));
+    };
+    auto select_pd = [](__m128d mask, __m128d a, __m128d b) {
+        return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+    };
+
+    for (; i + 2 <= last; i += 2) {
+        __m128d active    = _mm_cmpeq_pd(_mm_set_pd(st.failed[i+1], st.failed[i]), zero);
+        __m128d x         = _mm_loadu_pd(&st.x[i]);
+        __m128d y         = _mm_loadu_pd(&st.y[i]);
+        __m128d dir       = _mm_loadu_pd(&st.dir[i]);
+        __m128d speed     = _mm_loadu_pd(&st.speed[i]);
+        __m128d max_speed = _mm_loadu_pd(&st.max_speed[i]);
+        __m128d speed_ctl = _mm_loadu_pd(&st.speed_ctl[i]);
+        __m128d steer_ctl = _mm_loadu_pd(&st.steer_ctl[i]);
+        __m128d run_time  = _mm_loadu_pd(&st.run_time_us[i]);
+        __m128d s, c;
+
+        // update car position based on current direction and speed
+        __m128d distance = _mm_mul_pd(speed, _mm_set1_pd(distance_factor));
+        __m128i qi = _mm_cvtpd_epi32(_mm_mul_pd(dir, _mm_set1_pd(1/90.)));
+        __m128d r = _mm_mul_pd(_mm_sub_pd(dir, _mm_mul_pd(_mm_cvtepi32_pd(qi), _mm_set1_pd(90))), 
+                               _mm_set1_pd(DEG2RAD));
+        sincos_pd(r, s, c);
+        __m128i q64 = _mm_shuffle_epi32(qi, _MM_SHUFFLE(1,1,0,0));
+        __m128d swap  = _mm_castsi128_pd(_mm_cmpeq_epi32(_mm_and_si128(q64, one_i), one_i));
+        __m128d neg_a = _mm_castsi128_pd(_mm_cmpeq_epi32(_mm_and_si128(q64, two_i), two_i));
+        __m128d neg_b = _mm_castsi128_pd(_mm_cmpeq_epi32(_mm_and_si128(_mm_add_epi32(q64, one_i), two_i), two_i));
+        __m128d sin_dir = _mm_xor_pd(select_pd(swap, c, s), _mm_and_pd(neg_a, sign));
+        __m128d cos_dir = _mm_xor_pd(select_pd(swap, s, c), _mm_and_pd(neg_b, sign));
+        __m128d new_x = _mm_add_pd(x, _mm_mul_pd(distance, sin_dir));
+        __m128d new_y = _mm_sub_pd(y, _mm_mul_pd(distance, cos_dir));
+
+        // update car direction based upon steering control 
+        sincos_pd(_mm_mul_pd(steer_ctl, _mm_set1_pd(DEG2RAD)), s, c);
+        __m128d t = _mm_mul_pd(_mm_div_pd(distance, _mm_set1_pd(WHEEL_BASE_LENGTH)), s);
+        __m128d u = half_angle_pd(half_angle_pd(t));
+        __m128d u2 = _mm_mul_pd(u, u);
+        __m128d p = _mm_set1_pd(1/13.);
+        p = _mm_add_pd(_mm_set1_pd(-1/11.), _mm_mul_pd(u2, p));
+        p = _mm_add_pd(_mm_set1_pd(1/9.), _mm_mul_pd(u2, p));
+        p = _mm_add_pd(_mm_set1_pd(-1/7.), _mm_mul_pd(u2, p));
+        p = _mm_add_pd(_mm_set1_pd(1/5.), _mm_mul_pd(u2, p));
+        p = _mm_add_pd(_mm_set1_pd(-1/3.), _mm_mul_pd(u2, p));
+        p = _mm_add_pd(one, _mm_mul_pd(u2, p));
+        __m128d delta_dir = _mm_mul_pd(_mm_mul_pd(_mm_mul_pd(_mm_set1_pd(4), u), p), _mm_set1_pd(RAD2DEG));
+        __m128d new_dir = _mm_add_pd(dir, delta_dir);
+        new_dir = _mm_add_pd(new_dir, _mm_and_pd(_mm_cmplt_pd(new_dir, zero), _mm_set1_pd(360)));
+        new_dir = _mm_sub_pd(new_dir, _mm_and_pd(_mm_cmpge_pd(new_dir, _mm_set1_pd(360)), _mm_set1_pd(360)));
+
+        // update car speed based on speed control 
+        __m128d new_speed = _mm_add_pd(speed, _mm_mul_pd(speed_ctl, _mm_set1_pd(delta_speed_factor)));
+        __m128d moving    = _mm_or_pd(_mm_cmpge_pd(new_speed, _mm_set1_pd(0.2)), _mm_cmpgt_pd(speed_ctl, zero));
+        new_speed = _mm_and_pd(moving, _mm_min_pd(new_speed, max_speed));
+
+        // failed cars are left unchanged
+        _mm_storeu_pd(&st.x[i], select_pd(active, new_x, x));
+        _mm_storeu_pd(&st.y[i], select_pd(active, new_y, y));
+        _mm_storeu_pd(&st.dir[i], select_pd(active, new_dir, dir));
+        _mm_storeu_pd(&st.speed[i], select_pd(active, new_speed, speed));
+        _mm_storeu_pd(&st.run_time_us[i], 
+                      select_pd(active, _mm_add_pd(run_time, _mm_set1_pd(microsecs)), run_time));
+    }
+#endif
 
-    double distance;
-    double delta_dir;
+    for (; i < last; i++) {
+        double s, c;
 
+        // if car has failed then do nothing
+        if (st.failed[i]) {
+            continue;
+        }
+
+        // update run time
+        st.run_time_us[i] += microsecs;
+
+        // update car position based on current direction and speed
+        double distance = st.speed[i] * distance_factor;
+        int q = lrint(st.dir[i] * (1/90.));
+        sincos_poly((st.dir[i] - q * 90.) * DEG2RAD, s, c);
+        double sin_dir = (q & 1) ? c : s;
+        double cos_dir = (q & 1) ? s : c;
+        if (q & 2) sin_dir = -sin_dir;
+        if ((q + 1) & 2) cos_dir = -cos_dir;
+        double new_y = st.y[i] - distance * cos_dir;
+        st.x[i] += distance * sin_dir;
+        st.y[i] = new_y;
+
+        // update car direction based upon steering control 
+        sincos_poly(st.steer_ctl[i] * DEG2RAD, s, c);
+        double dir = st.dir[i] + atan_poly(distance / WHEEL_BASE_LENGTH * s) * RAD2DEG;
+        if (dir < 0) dir += 360;
+        if (dir >= 360) dir -= 360;
+        st.dir[i] = dir;
+
+        // update car speed based on speed control; a slowing car that's down to 
+        // 0.2 mph stops, but a car speeding up from a stop may take several steps
+        // to get past 0.2 mph
+        double speed = st.speed[i] + st.speed_ctl[i] * delta_speed_factor;
+        if (speed < 0.2 && st.speed_ctl[i] <= 0) {
+            speed = 0;
+        } else if (speed > st.max_speed[i]) {
+            speed = st.max_speed[i];
+        }
+        st.speed[i] = speed;
+    }
+}
+
+void car::update_mechanics(double microsecs)
+{
     // XXX check for crash due to:
     // - over steering
     // - taking a turn at too high speed
     // - others?
 
-    // if car has failed then do nothing
-    if (get_failed()) {
-        return;
-    }
+    update_rows(state, row, row + 1, microsecs);
+}
 
-    // update run time
-    run_time_us += microsecs;
-
-    // update car position based on current direction and speed
-    distance = speed * microsecs * (5280./3600./1e6);
-    x += distance * cos((dir+270.) * (M_PI/180.0));
-    y += distance * sin((dir+270.) * (M_PI/180.0));
-
-    // update car direction based upon steering control 
-    delta_dir = atan(distance / WHEEL_BASE_LENGTH * sin(steer_ctl*(M_PI/180.))) * (180./M_PI);
-    dir = sanitize_direction(dir + delta_dir);
-    
-    // update car speed based on speed control 
-    speed += speed_ctl * (microsecs / 1000000.);
-    if (speed < 0.2) {
-        speed = 0;
-    } else if (speed > max_speed) {
-        speed = max_speed;
-    }
+void car::update_all_mechanics(double microsecs)
+{
+    update_rows(state, 0, state.size(), microsecs);
 }
 
 // -----------------  PLACE CAR IN WORLD  -------------------------------------------
 
 void car::place_car_in_world()
 {
-    int direction = sanitize_direction(dir + 0.5);
+    double x = state.x[row];
+    double y = state.y[row];
+    int direction = sanitize_direction(state.dir[row] + 0.5);
     assert(direction >= 0 && direction < 360);
 
     if (!get_failed()) {
         w.place_object(x, y, CAR_PIXELS_WIDTH, CAR_PIXELS_HEIGHT,
-                    reinterpret_cast<unsigned char *>(good_car_pixels[direction]));
+                    reinterpret_cast<unsigned char *>(good_car_pixels[direction]),
+                    reinterpret_cast<unsigned char *>(car_pixels_mask[direction]));
     } else {
         w.place_object(x, y, CAR_PIXELS_WIDTH, CAR_PIXELS_HEIGHT,
-                    reinterpret_cast<unsigned char *>(failed_car_pixels[direction]));
+                    reinterpret_cast<unsigned char *>(failed_car_pixels[direction]),
+                    reinterpret_cast<unsigned char *>(car_pixels_mask[direction]));
     }
 }
 
@@ -266,7 +493,7 @@ void car::draw_view(int pid)
         assert(t);
     }
 
-    w.get_view(x, y, dir, MAX_VIEW_WIDTH, MAX_VIEW_HEIGHT, view);
+    w.get_view(get_x(), get_y(), get_dir(), MAX_VIEW_WIDTH, MAX_VIEW_HEIGHT, view);
     d.texture_set_rect(t, 0, 0, MAX_VIEW_WIDTH, MAX_VIEW_HEIGHT, view, MAX_VIEW_WIDTH);
     d.texture_draw2(t, pid);
 
@@ -286,7 +513,7 @@ void car::draw_dashboard(int pid)
 
     // current speed
     std::ostringstream s;
-    s << fixed << setprecision(0) << speed;
+    s << fixed << setprecision(0) << get_speed();
     d.text_draw(s.str(), 0.5, 1, pid);
 
     // id and failed_str / 'ok'
@@ -301,7 +528,7 @@ void car::draw_dashboard(int pid)
 
     // run time
     int hours, minutes, seconds;
-    seconds = run_time_us / 1000000;
+    seconds = state.run_time_us[row] / 1000000;
     hours = seconds / 3600;
     seconds -= hours * 3600;
     minutes = seconds / 60;
@@ -311,7 +538,7 @@ void car::draw_dashboard(int pid)
     d.text_draw(s.str(), 2.1, 17, pid, false, 0, 1);
 
     // steering control
-    steer_ctl_smoothed = (steer_ctl + 9 * steer_ctl_smoothed) / 10;
+    steer_ctl_smoothed = (get_steer_ctl() + 9 * steer_ctl_smoothed) / 10;
     if (fabs(steer_ctl_smoothed) < .1) {
         steer_ctl_smoothed = 0;
     }
@@ -342,7 +569,7 @@ void car::draw_dashboard(int pid)
     const int SPEED_CONTROL_Y = 6;
     const int SPEED_CONTROL_BRAKE_X = 465;
 
-    speed_ctl_smoothed = (speed_ctl + 9 * speed_ctl_smoothed) / 10;
+    speed_ctl_smoothed = (get_speed_ctl() + 9 * speed_ctl_smoothed) / 10;
     if (fabs(speed_ctl_smoothed) < .1) {
         speed_ctl_smoothed = 0;
     }
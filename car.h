@@ -23,8 +23,32 @@ SOFTWARE.
 #ifndef __CAR_H__
 #define __CAR_H__
 
+#include <vector>
+
 #include "display.h"
 #include "world.h"
+#include "utils.h"
+
+// car_state holds the mechanical state of all cars as a structure of arrays, one 
+// row per car; car::update_all_mechanics streams through the rows. rows are kept 
+// packed, a row is removed by moving the last row into its place, and owner is 
+// used to tell the car whose row moved.
+struct car_state {
+    std::vector<class car *>    owner;
+    std::vector<double>         x;
+    std::vector<double>         y;
+    std::vector<double>         dir;
+    std::vector<double>         speed;
+    std::vector<double>         max_speed;
+    std::vector<double>         speed_ctl;
+    std::vector<double>         steer_ctl;
+    std::vector<double>         run_time_us;
+    std::vector<unsigned char>  failed;
+
+    int size() { return owner.size(); }
+    int add_row(class car *c);
+    void remove_row(int row);
+};
 
 class car {
 public:
@@ -41,22 +65,29 @@ public:
     world &get_world() { return w; }
     display &get_display() { return d; }
     int get_id() { return id; }
-    double get_x() { return x; }
-    double get_y() { return y; }
-    double get_dir() { return dir; }
-    double get_speed() { return speed; }
-    double get_max_speed() { return max_speed; }
-    double get_speed_ctl() { return speed_ctl; }
-    double get_steer_ctl() { return steer_ctl; }
-    bool get_failed() { return failed; };
+    double get_x() { return state.x[row]; }
+    double get_y() { return state.y[row]; }
+    double get_dir() { return state.dir[row]; }
+    double get_speed() { return state.speed[row]; }
+    double get_max_speed() { return state.max_speed[row]; }
+    double get_speed_ctl() { return state.speed_ctl[row]; }
+    double get_steer_ctl() { return state.steer_ctl[row]; }
+    bool get_failed() { return state.failed[row]; };
     string get_failed_str() { return failed_str; };
 
     void set_speed_ctl(double val);
     void set_steer_ctl(double val);
-    void set_failed(const string &str) { failed_str = str; failed = true; }
+    void set_failed(const string &str) { failed_str = str; state.failed[row] = true; }
     void update_mechanics(double microsecs);
     void place_car_in_world();
 
+    static void update_all_mechanics(double microsecs);
+
+    // each car has its own random stream, derived from the run's random seed and the car's id
+    static void set_random_seed(uint64_t seed) { random_seed = seed; }
+    static uint64_t get_random_seed() { return random_seed; }
+    int random_uniform_int(int min, int max) { return random.uniform_int(min, max); }
+
     virtual void draw_view(int pid);
     virtual void draw_dashboard(int pid);
     virtual void update_controls(double microsecs);
@@ -66,20 +97,16 @@ private:
     world &w;
     static display::texture *texture;
 
-    // car state
+    // car state, the mechanical state is in row 'row' of state
+    friend struct car_state;
+    static car_state state;
+    static uint64_t random_seed;
+    int    row;
     int    id;
-    double x;
-    double y;
-    double dir;
-    double speed;
-    double max_speed;
-    double speed_ctl;
+    random_stream random;
     double speed_ctl_smoothed;
-    double steer_ctl;
     double steer_ctl_smoothed;
-    bool   failed;
     string failed_str;
-    long   run_time_us;
 };
 
 #endif
@@ -530,19 +530,19 @@ struct display::texture * display::texture_create(int w, int h)
 
     pixels = new unsigned char [w*h];
     memset(pixels,TRANSPARENT,w*h); 
-    t = texture_create(pixels,w,h);
+    t = texture_create(pixels,w,h,w);
     delete [] pixels;    
     return t;
 }
 
-struct display::texture * display::texture_create(unsigned char * pixels, int w, int h)
+struct display::texture * display::texture_create(unsigned char * pixels, int w, int h, int pitch)
 {
     int ret;
 
     // creae surface from pixels
     SDL_Surface * surface;
     surface = SDL_CreateRGBSurfaceFrom(pixels, 
-                                       w, h, 8, w,   // width, height, depth, pitch
+                                       w, h, 8, pitch,   // width, height, depth, pitch
                                        0, 0, 0, 0);  // RGBA masks, not used
     DEBUG("surface " << surface << endl);
 
@@ -599,7 +599,10 @@ void display::texture_set_rect(struct texture * t, int x, int y, int w, int h, u
     unsigned int * rp;
     SDL_Rect rect;
 
-    raw_pixels = new unsigned int [w*h];
+    if ((int)texture_rect_buff.size() < w*h) {
+        texture_rect_buff.resize(w*h);
+    }
+    raw_pixels = &texture_rect_buff[0];
     rp = raw_pixels;
 
     rect.x = x;
@@ -615,8 +618,6 @@ void display::texture_set_rect(struct texture * t, int x, int y, int w, int h, u
     }
 
     SDL_UpdateTexture(reinterpret_cast<SDL_Texture*>(t), &rect, raw_pixels, 4*w);
-
-    delete [] raw_pixels;
 }
 
 void display::texture_destroy(struct texture * t)
@@ -24,6 +24,7 @@ SOFTWARE.
 #define __DISPLAY_H__
 
 #include <string>
+#include <vector>
 
 using std::string;
 
@@ -108,7 +109,7 @@ public:
                   int fid=0, bool center=false, int field_cols=999);
 
     struct texture * texture_create(int w, int h);
-    struct texture * texture_create(unsigned char * pixels, int w, int h);
+    struct texture * texture_create(unsigned char * pixels, int w, int h, int pitch);
     void texture_set_pixel(struct texture * t, int x, int y, unsigned char pixel);
     void texture_clr_pixel(struct texture * t, int x, int y);
     void texture_set_rect(struct texture * t, int x, int y, int w, int h, unsigned char * pixels, int pitch);
@@ -156,6 +157,9 @@ private:
     int mouse_motion_y;
     struct Mix_Chunk * event_sound;
 
+    // texture_set_rect's buffer of raw pixels, reused from call to call
+    std::vector<unsigned int> texture_rect_buff;
+
     // print screen
     void print_screen(void);
 };
@@ -31,6 +31,8 @@ SOFTWARE.
 #include "logging.h"
 #include "utils.h"
 
+using std::istringstream;
+
 // display and pane size
 #define DISPLAY_WIDTH        1420
 #define DISPLAY_HEIGHT       800
@@ -54,8 +56,8 @@ SOFTWARE.
 #define PANE_MSG_BOX_HEIGHT  50 
 
 // world display pane center coordinates and zoom
-double       center_x = world::WORLD_WIDTH / 2;
-double       center_y = world::WORLD_HEIGHT / 2;
+double       center_x;
+double       center_y;
 const double ZOOM_FACTOR = 1.1892071;
 const double MAX_ZOOM    = 256.0 - .01;
 const double MIN_ZOOM    = (1.0 / ZOOM_FACTOR) + .01;
@@ -111,12 +113,23 @@ int main(int argc, char **argv)
     //
 
     // get options
+    int world_width = world::WORLD_WIDTH;
+    int world_height = world::WORLD_HEIGHT;
     while (true) {
-        char opt_char = getopt(argc, argv, "");
+        char opt_char = getopt(argc, argv, "w:");
         if (opt_char == -1) {
             break;
         }
         switch (opt_char) {
+        case 'w': {
+            istringstream s(optarg);
+            char x_char = 0;
+            s >> world_width >> x_char >> world_height;
+            if (s.fail() || !s.eof() || x_char != 'x' || !world::valid_world_size(world_width, world_height)) {
+                ERROR("invalid world size '" << s.str() << "', expected WIDTHxHEIGHT, multiples of 64 up to 65536" << endl);
+                return 1;
+            }
+            break; }
         default:
             return 1;
         }
@@ -136,9 +149,12 @@ int main(int argc, char **argv)
     car::static_init(d);
 
     // create the world
-    world w(d);
+    world w(d, world_width, world_height);
     bool success = w.read(filename);
+    w.materialize();
     display_message(success ? "READ SUCCESS" : "READ FAILURE");
+    center_x = w.get_width() / 2;
+    center_y = w.get_height() / 2;
 
     //
     // MAIN LOOP
@@ -231,6 +247,7 @@ int main(int argc, char **argv)
         int eid_create_roads=-1, eid_edit_pixels=-1;
 
         int eid_1=-1, eid_9=-1, eid_run=-1, eid_stop=-1, eid_back=-1, eid_rol=-1, eid_ror=-1, eid_cr_click=-1;
+        int eid_launch=-1;
         __attribute__((unused)) int eid_2=-1, eid_3=-1, eid_4=-1, eid_5=-1, eid_6=-1, eid_7=-1, eid_8=-1;
 
         int eid_color_select[MAX_EDIT_PIXELS_COLOR_SELECT];
@@ -265,6 +282,7 @@ int main(int argc, char **argv)
             eid_ror      = d.text_draw("ROR",           3, 8, PANE_CTRL_ID, true, display::KEY_RIGHT);
             eid_run      = d.text_draw("RUN",           5, 0, PANE_CTRL_ID, true, 'R');      
             eid_stop     = d.text_draw("STOP",          5, 8, PANE_CTRL_ID, true, 'S');      
+            eid_launch   = d.text_draw("ADD_LAUNCH",   10, 0, PANE_CTRL_ID, true, 'L');
             eid_back     = d.text_draw("BACK",         13,16, PANE_CTRL_ID, true, 'B'); 
             eid_cr_click = d.event_register(display::ET_MOUSE_RIGHT_CLICK, PANE_WORLD_ID);
             break;
@@ -312,6 +330,7 @@ int main(int argc, char **argv)
             }
             if (event.eid == eid_reset) {
                 bool success = w.read(filename);
+                w.materialize();
                 display_message(success ? "READ SUCCESS" : "READ FAILURE");
                 d.event_play_sound();
                 break;
@@ -358,6 +377,12 @@ int main(int argc, char **argv)
                     d.event_play_sound();
                     break;
                 }
+                if (event.eid == eid_launch) {
+                    bool success = w.add_launch_point(create_road_x, create_road_y, create_road_dir);
+                    display_message(success ? "LAUNCH POINT ADDED" : "LAUNCH POINT FAILURE");
+                    d.event_play_sound();
+                    break;
+                }
                 if (event.eid == eid_back) {
                     create_roads_run = false;
                     mode = MAIN;
@@ -23,6 +23,8 @@ SOFTWARE.
 #ifndef __UTILS_H__
 #define __UTILS_H__
 
+#include <cstdint>
+
 void microsec_sleep(long us);
 long microsec_timer(void);
 
@@ -39,4 +41,34 @@ inline double sanitize_direction(double d)
     }
 }
 
+// random_stream is a counter based random number generator: the n'th number of 
+// a stream is a hash of the seed, the stream number and n, so each user can have
+// its own stream, and the numbers it gets don't depend on what other streams 
+// are used, or by which thread
+class random_stream {
+public:
+    random_stream(uint64_t seed, uint64_t stream) : seed(seed), stream(stream), counter(0) { }
+
+    uint64_t next() {
+        // splitmix64 finalizer applied to the stream's key and counter
+        uint64_t z = seed ^ (stream * 0x9e3779b97f4a7c15ULL) ^ (++counter * 0xbf58476d1ce4e5b9ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        z = (z ^ (z >> 31)) * 0x9e3779b97f4a7c15ULL;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        return z ^ (z >> 31);
+    }
+
+    // returns a random int in range min to max inclusive
+    int uniform_int(int min, int max) {
+        uint64_t range = (uint64_t)max - min + 1;
+        return min + (int)(((next() >> 32) * range) >> 32);
+    }
+
+private:
+    uint64_t seed;
+    uint64_t stream;
+    uint64_t counter;
+};
+
 #endif
@@ -21,9 +21,21 @@ SOFTWARE.
 */
 
 #include <fstream>
+#include <cstdio>
 #include <cassert>
 #include <cstring>
+#include <cerrno>
 #include <cmath>  
+#include <algorithm>
+#include <tuple>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 #include "world.h"
 #include "logging.h"
@@ -35,121 +47,598 @@ using std::ios;
 
 // -----------------  WORLD CLASS STATIC INITIALIZATION  ----------------------------
 
-short world::get_view_dx_tbl[360][MAX_GET_VIEW_XY][MAX_GET_VIEW_XY];
-short world::get_view_dy_tbl[360][MAX_GET_VIEW_XY][MAX_GET_VIEW_XY];
+enum world::get_view_engine world::get_view_engine = world::GET_VIEW_STEP;
+enum world::get_view_sampling world::get_view_sampling = world::GET_VIEW_WHOLE_DEGREE;
+bool world::get_view_avx2 = false;
+enum world::world_layout world::world_layout = world::WORLD_LINEAR;
+struct world::get_view_coeff world::get_view_coeff_tbl[360];
+string world::get_view_tbl_cache_filename = "get_view_tbl.dat";
+bool world::get_view_tbl_cache_tried = false;
+std::mutex world::get_view_tbl_mutex;
+std::atomic<bool> world::get_view_tbl_built[GET_VIEW_TBL_HEADINGS];
+short (*world::get_view_dx_tbl[GET_VIEW_TBL_HEADINGS])[GET_VIEW_TBL_WIDTH];
+short (*world::get_view_dy_tbl[GET_VIEW_TBL_HEADINGS])[GET_VIEW_TBL_WIDTH];
 
 void world::static_init(void)
 {
-    // init get_view rotation tables
-    int d1,h1,w1;
-    INFO("sizeof of tables " << 
-           (sizeof(get_view_dx_tbl) + sizeof(get_view_dy_tbl)) / 0x100000 << " MB" << endl);
-    for (d1 = 0; d1 < 360; d1++) {
-        double sindir = sin(d1 * (M_PI/180.0));
-        double cosdir = cos(d1 * (M_PI/180.0));
-        for (h1 = 0; h1 < MAX_GET_VIEW_XY; h1++) {
-            for (w1 = -MAX_GET_VIEW_XY/2; w1 < -MAX_GET_VIEW_XY/2 + MAX_GET_VIEW_XY; w1++) {
-                get_view_dx_tbl[d1][h1][w1+(MAX_GET_VIEW_XY/2)] = w1 * cosdir + h1 * sindir;
-                get_view_dy_tbl[d1][h1][w1+(MAX_GET_VIEW_XY/2)] = w1 * sindir - h1 * cosdir;
-            }
+    // init get_view per heading coefficients, used by the step engine
+    for (int d1 = 0; d1 < 360; d1++) {
+        init_get_view_coeff(d1, get_view_coeff_tbl[d1]);
+    }
+
+    // use the avx2 step engine kernel if this cpu has it
+#if defined(__x86_64__)
+    get_view_avx2 = __builtin_cpu_supports("avx2");
+#endif
+    INFO("get_view avx2 kernel " << (get_view_avx2 ? "enabled" : "not supported") << endl);
+
+    // the rotation tables, used only by the table engine, are built as needed 
+    // by get_view_table
+}
+
+// Headings are folded onto a base heading from 0 to 45 degrees: dir is the base
+// heading, mirrored about the view's center line if mirror is set, and then 
+// turned by quarter turns. Mirroring negates the sine, and a quarter turn 
+// changes cosine,sine to -sine,cosine; both are exact in double, so the view 
+// offsets of most headings can be derived from the base heading's.
+double world::fold_direction(double dir, int &quarter, bool &mirror)
+{
+    quarter = dir / 90;
+    double base = dir - 90 * quarter;
+
+    mirror = (base > 45);
+    if (mirror) {
+        base = 90 - base;
+        quarter = (quarter + 1) % 4;
+    }
+    return base;
+}
+
+void world::init_get_view_coeff(double dir, struct get_view_coeff &c)
+{
+    const double ONE_FP = 1L << GET_VIEW_FP_SHIFT;
+    int quarter;
+    bool mirror;
+
+    c.sindir = sin(dir * (M_PI/180.0));
+    c.cosdir = cos(dir * (M_PI/180.0));
+
+    // the folded sine and cosine are not always the heading's own (the cosine
+    // of 90 degrees is 6e-17, not the 0 of a quarter turn, and 60 degrees is not
+    // quite 30 mirrored); the table engine evaluates those headings in double,
+    // so that every heading's view is the same as the full rotation tables'
+    double base = fold_direction(dir, quarter, mirror);
+    double sindir = sin(base * (M_PI/180.0));
+    double cosdir = cos(base * (M_PI/180.0));
+    if (mirror) {
+        sindir = -sindir;
+    }
+    for (int i = 0; i < quarter; i++) {
+        double t = cosdir;
+        cosdir = -sindir;
+        sindir = t;
+    }
+    c.folds_exactly = (cosdir == c.cosdir && sindir == c.sindir);
+
+    c.cos_fp = llround(c.cosdir * ONE_FP);
+    c.sin_fp = llround(c.sindir * ONE_FP);
+
+    // when a coefficient is rounded to a short binary fraction (such as the 
+    // 0.49999999999999994 sine of 30 degrees becoming 0.5) samples can land exactly
+    // on a pixel boundary, where the rotation tables' double rounding decides which
+    // pixel is used; these headings are evaluated in double so both engines return
+    // the same view
+    const long SHORT_FRACTION_MASK = (1L << (GET_VIEW_FP_SHIFT-10)) - 1;
+    c.eval_in_double = (((c.cos_fp & SHORT_FRACTION_MASK) == 0 && c.cos_fp / ONE_FP != c.cosdir) ||
+                        ((c.sin_fp & SHORT_FRACTION_MASK) == 0 && c.sin_fp / ONE_FP != c.sindir));
+}
+
+// builds the rotation tables for base heading d1; called by the car update 
+// controls threads, so the first thread to need a heading builds it while 
+// the others wait; the first call instead maps all the tables from the cache
+// file, if that works
+void world::init_get_view_tbl(int d1)
+{
+    std::lock_guard<std::mutex> lock(get_view_tbl_mutex);
+    if (get_view_tbl_built[d1]) {
+        return;
+    }
+
+    if (!get_view_tbl_cache_tried) {
+        get_view_tbl_cache_tried = true;
+        if (map_get_view_tbl_cache()) {
+            return;
+        }
+    }
+
+    short (*dx_tbl)[GET_VIEW_TBL_WIDTH] = new short [MAX_GET_VIEW_XY][GET_VIEW_TBL_WIDTH];
+    short (*dy_tbl)[GET_VIEW_TBL_WIDTH] = new short [MAX_GET_VIEW_XY][GET_VIEW_TBL_WIDTH];
+    fill_get_view_tbl(d1, dx_tbl, dy_tbl);
+    get_view_dx_tbl[d1] = dx_tbl;
+    get_view_dy_tbl[d1] = dy_tbl;
+    get_view_tbl_built[d1] = true;
+}
+
+void world::fill_get_view_tbl(int d1, short (*dx_tbl)[GET_VIEW_TBL_WIDTH], short (*dy_tbl)[GET_VIEW_TBL_WIDTH])
+{
+    double sindir = sin(d1 * (M_PI/180.0));
+    double cosdir = cos(d1 * (M_PI/180.0));
+    for (int h1 = 0; h1 < MAX_GET_VIEW_XY; h1++) {
+        for (int w1 = -MAX_GET_VIEW_XY/2; w1 <= MAX_GET_VIEW_XY/2; w1++) {
+            dx_tbl[h1][w1+(MAX_GET_VIEW_XY/2)] = w1 * cosdir + h1 * sindir;
+            dy_tbl[h1][w1+(MAX_GET_VIEW_XY/2)] = w1 * sindir - h1 * cosdir;
         }
     }
 }
 
+// renames a temp file that has been written and closed to filename; the temp
+// file is flushed to disk first, and the directory after, so that after a crash
+// filename is either the old file or all of the new one
+static bool rename_synced(const string &tmp_filename, const string &filename)
+{
+    int fd = open(tmp_filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = (fsync(fd) == 0);
+    close(fd);
+    if (!ok || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+        return false;
+    }
+
+    size_t slash = filename.rfind('/');
+    string dirname = (slash == string::npos ? "." : slash == 0 ? "/" : filename.substr(0, slash));
+    int dfd = open(dirname.c_str(), O_RDONLY|O_DIRECTORY);
+    if (dfd < 0) {
+        return false;
+    }
+    ok = (fsync(dfd) == 0);
+    close(dfd);
+    return ok;
+}
+
+// The cache file holds a header, padded to GET_VIEW_TBL_CACHE_HDR_SIZE, 
+// followed by the dx and dy tables of each base heading. It is mapped read 
+// only and shared, so concurrent av processes share one copy of the tables 
+// in the page cache. If the file is missing or doesn't match this build's 
+// header it is rebuilt, written to a temp file, and renamed into place.
+bool world::map_get_view_tbl_cache()
+{
+    const size_t TBL_SIZE = sizeof(short) * MAX_GET_VIEW_XY * GET_VIEW_TBL_WIDTH;
+    const size_t FILE_SIZE = GET_VIEW_TBL_CACHE_HDR_SIZE + 2 * GET_VIEW_TBL_HEADINGS * TBL_SIZE;
+    struct get_view_tbl_cache_hdr expected_hdr;
+    string filename = get_view_tbl_cache_filename;
+
+    memset(&expected_hdr, 0, sizeof(expected_hdr));
+    strcpy(expected_hdr.magic, "AVGVTBL");
+    expected_hdr.version  = GET_VIEW_TBL_CACHE_VERSION;
+    expected_hdr.headings = GET_VIEW_TBL_HEADINGS;
+    expected_hdr.height   = MAX_GET_VIEW_XY;
+    expected_hdr.width    = GET_VIEW_TBL_WIDTH;
+
+    // if the cache file doesn't exist or is stale then create it
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat st;
+    struct get_view_tbl_cache_hdr hdr;
+    if (fd < 0 ||
+        fstat(fd, &st) != 0 || 
+        (size_t)st.st_size != FILE_SIZE ||
+        pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        memcmp(&hdr, &expected_hdr, sizeof(hdr)) != 0)
+    {
+        if (fd >= 0) {
+            close(fd);
+        }
+
+        INFO("creating " << filename << endl);
+        unsigned char * buff = new unsigned char [FILE_SIZE];
+        memset(buff, 0, GET_VIEW_TBL_CACHE_HDR_SIZE);
+        memcpy(buff, &expected_hdr, sizeof(expected_hdr));
+        for (int d1 = 0; d1 < GET_VIEW_TBL_HEADINGS; d1++) {
+            unsigned char * tbl = buff + GET_VIEW_TBL_CACHE_HDR_SIZE + 2 * d1 * TBL_SIZE;
+            fill_get_view_tbl(d1, 
+                              reinterpret_cast<short (*)[GET_VIEW_TBL_WIDTH]>(tbl),
+                              reinterpret_cast<short (*)[GET_VIEW_TBL_WIDTH]>(tbl + TBL_SIZE));
+        }
+
+        string tmp_filename = filename + ".tmp." + std::to_string(getpid());
+        ofstream ofs;
+        ofs.open(tmp_filename, ios::out|ios::binary|ios::trunc);
+        ofs.write(reinterpret_cast<char*>(buff), FILE_SIZE);
+        ofs.close();
+        delete [] buff;
+        if (!ofs.good() || !rename_synced(tmp_filename, filename)) {
+            WARNING(filename << " create failed, tables will not be cached" << endl);
+            unlink(tmp_filename.c_str());
+            return false;
+        }
+
+        fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            WARNING(filename << " open failed, tables will not be cached" << endl);
+            return false;
+        }
+    }
+
+    // map the cache file, and point the tables at it
+    void * addr = mmap(NULL, FILE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        WARNING(filename << " mmap failed, tables will not be cached" << endl);
+        return false;
+    }
+    for (int d1 = 0; d1 < GET_VIEW_TBL_HEADINGS; d1++) {
+        unsigned char * tbl = reinterpret_cast<unsigned char *>(addr) + GET_VIEW_TBL_CACHE_HDR_SIZE + 2 * d1 * TBL_SIZE;
+        get_view_dx_tbl[d1] = reinterpret_cast<short (*)[GET_VIEW_TBL_WIDTH]>(tbl);
+        get_view_dy_tbl[d1] = reinterpret_cast<short (*)[GET_VIEW_TBL_WIDTH]>(tbl + TBL_SIZE);
+        get_view_tbl_built[d1] = true;
+    }
+    return true;
+}
+
 // -----------------  CONSTRUCTOR / DESTRUCTOR  -------------------------------------
 
-world::world(display &display) : d(display)
+bool world::valid_world_size(int width, int height)
+{
+    return width >= TILE_SIZE && width <= MAX_WORLD_WIDTH && (width & TILE_MASK) == 0 &&
+           height >= TILE_SIZE && height <= MAX_WORLD_HEIGHT && (height & TILE_MASK) == 0;
+}
+
+world::world(display &display, int width_arg, int height_arg) : d(display)
 {
-    static_pixels           = new unsigned char [WORLD_HEIGHT] [WORLD_WIDTH];
-    memset(static_pixels, 0, WORLD_HEIGHT*WORLD_WIDTH);
-    pixels                  = new unsigned char [WORLD_HEIGHT] [WORLD_WIDTH];
-    memset(pixels, 0, WORLD_HEIGHT*WORLD_WIDTH);
+    layout                  = world_layout;
     texture                 = NULL;
-    memset(placed_object_list, 0, sizeof(placed_object_list));
-    max_placed_object_list  = 0;
+    objects_pending         = false;
     center_x                = 0;
     center_y                = 0;
     zoom                    = 0;
 
+    alloc_layers(width_arg, height_arg);
     clear();
 }
 
 world::~world()
 {
     d.texture_destroy(texture);
-    delete [] static_pixels;
-    delete [] pixels;
+    free_layers();
 }
 
-// -----------------  DRAW WORLD AND WORLD OBJECTS  ---------------------------------
-
-void world::place_object_init()
+// allocates the world buffers for a width x height world, and inits their guard
+// bands; the pixels buffer and tile_pool have a spare row or slot because the 
+// avx2 get_view kernel gathers 4 bytes at a time, and so reads up to 3 bytes 
+// past the last pixel it samples. the linear buffers are mapped, so that read 
+// can map a world file over their world rows. the world is left unset, and a
+// tiled world's tiles must be reset before use.
+void world::alloc_layers(int width_arg, int height_arg)
 {
-    for (int i = 0; i < max_placed_object_list; i++) {
-        struct rect &rect = placed_object_list[i];
+    assert(valid_world_size(width_arg, height_arg));
 
-        // restores pixels from static_pixels
-        for (int y = rect.y; y < rect.y+rect.h; y++) {
-            memcpy(&pixels[y][rect.x], &static_pixels[y][rect.x], rect.w);
+    width                   = width_arg;
+    height                  = height_arg;
+    buff_height             = WORLD_GUARD + height + WORLD_GUARD;
+    tiles_per_row           = (WORLD_GUARD + width + WORLD_GUARD) / TILE_SIZE;
+    static_pixels           = NULL;
+    pixels                  = NULL;
+    static_mapped           = false;
+    static_tile_dir         = NULL;
+    tile_dir                = NULL;
+    tile_pool               = NULL;
+    max_tile_slots          = 0;
+    next_tile_slot          = UNIFORM_TILE_SLOTS;
+    free_tile_slots.clear();
+    memset(uniform_tile_ready, 0, sizeof(uniform_tile_ready));
+    texture_scale           = std::max((width + MAX_TEXTURE_SIZE - 1) / MAX_TEXTURE_SIZE,
+                                       (height + MAX_TEXTURE_SIZE - 1) / MAX_TEXTURE_SIZE);
+
+    if (layout == WORLD_LINEAR) {
+        void * addr1 = mmap(NULL, (long)buff_height*width, PROT_READ|PROT_WRITE, 
+                            MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        void * addr2 = mmap(NULL, (long)(buff_height+1)*width, PROT_READ|PROT_WRITE, 
+                            MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (addr1 == MAP_FAILED || addr2 == MAP_FAILED) {
+            FATAL("mmap world buffers, " << strerror(errno) << endl);
+        }
+        static_pixels = reinterpret_cast<unsigned char *>(addr1);
+        pixels = reinterpret_cast<unsigned char *>(addr2);
+        memset(pixels, display::PURPLE, (long)WORLD_GUARD*width);
+        memset(&pixels[linear_offset(0,height)], display::PURPLE, (long)(WORLD_GUARD+1)*width);
+    } else {
+        long tiles = (long)tiles_per_row * (buff_height / TILE_SIZE);
+        long world_tiles = (long)(width / TILE_SIZE) * (height / TILE_SIZE);
+        max_tile_slots = UNIFORM_TILE_SLOTS + 2 * world_tiles;
+        static_tile_dir = new unsigned int [tiles];
+        tile_dir = new unsigned int [tiles];
+        void * addr = mmap(NULL, (long)(max_tile_slots+1)*TILE_BYTES, PROT_READ|PROT_WRITE, 
+                           MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+        if (addr == MAP_FAILED) {
+            FATAL("mmap world tile pool, " << strerror(errno) << endl);
         }
+        tile_pool = reinterpret_cast<unsigned char *>(addr);
+    }
+
+    forget_saved_file();
+}
 
-        // restores the texture
-        d.texture_set_rect(texture, 
-                           rect.x, rect.y, rect.w, rect.h, 
-                           &pixels[rect.y][rect.x], 
-                           WORLD_WIDTH);
+void world::free_layers()
+{
+    if (static_pixels != NULL) {
+        munmap(static_pixels, (long)buff_height*width);
+        munmap(pixels, (long)(buff_height+1)*width);
+    }
+    delete [] static_tile_dir;
+    delete [] tile_dir;
+    if (tile_pool != NULL) {
+        munmap(tile_pool, (long)(max_tile_slots+1)*TILE_BYTES);
     }
-    max_placed_object_list = 0;
 }
 
-void world::place_object(int x, int y, int w, int h, unsigned char * p)
+// -----------------  DRAW WORLD AND WORLD OBJECTS  ---------------------------------
+
+void world::place_object_init()
+{
+    // the objects placed last time become the ones to compare with
+    show_placed_objects();
+    placed_objects.clear();
+    objects_pending = true;
+}
+
+// places an object, centered at x,y, that will be drawn on the dynamic layer the
+// next time that it's looked at; the object's pixels must not change until then.
+// mask, if given, is 0xff for each pixel that's drawn and 0 for each that's
+// TRANSPARENT, and saves working that out each time the object is drawn
+void world::place_object(int x, int y, int w, int h, unsigned char * p, unsigned char * mask)
 {
     // adjuct x,y to top left corner of the object's rect
     x -= w / 2;
     y -= h / 2;
 
     // if object is off an edge of the world then skip
-    if (x < 0 || x+w >= WORLD_WIDTH ||
-        y < 0 || y+h >= WORLD_HEIGHT) 
+    if (x < 0 || x+w >= width ||
+        y < 0 || y+h >= height) 
     {
         return;
     }
 
-    // save the location of the object being placed on placed_object_list
-    struct rect &rect = placed_object_list[max_placed_object_list];
-    rect.x = x;
-    rect.y = y;
-    rect.w = w;
-    rect.h = h;
-    max_placed_object_list++;
+    struct placed_object obj = { { x, y, w, h }, p, mask };
+    placed_objects.push_back(obj);
+}
+
+// copies the n pixels at src whose mask is 0xff to dst, without branching on
+// each pixel
+static inline void blend_row(unsigned char * dst, const unsigned char * src, const unsigned char * mask, int n)
+{
+    int i = 0;
+
+#if defined(__x86_64__)
+    for (; i + 16 <= n; i += 16) {
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&dst[i]));
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i]));
+        __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&mask[i]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[i]), _mm_or_si128(_mm_and_si128(m, s), _mm_andnot_si128(m, d)));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] = (src[i] & mask[i]) | (dst[i] & ~mask[i]);
+    }
+}
+
+// brings the dynamic layer up to date with the placed objects; this is called
+// by everything that looks at the dynamic layer, so it may be called by several
+// get_view threads at once
+void world::update_shown_objects()
+{
+    std::unique_lock<std::mutex> objects_lck(objects_mutex);
+    if (!objects_pending) {
+        return;
+    }
+
+    // pair each placed object with a shown object at the same place and with the
+    // same pixels; most objects are placed in the same order each time, so that's
+    // tried first, and the rest are paired by sorting them
+    int n = placed_objects.size();
+    int m = shown_objects.size();
+    std::vector<bool> placed_kept(n, false);
+    std::vector<bool> shown_kept(m, false);
+    std::vector<int> shown_idx(n, -1);
+    std::vector<int> placed_rest, shown_rest;
+    auto same = [](const struct placed_object &a, const struct placed_object &b) {
+        return a.rect.x == b.rect.x && a.rect.y == b.rect.y && a.rect.w == b.rect.w && 
+               a.rect.h == b.rect.h && a.pixels == b.pixels;
+    };
+    for (int i = 0; i < n; i++) {
+        if (i < m && same(placed_objects[i], shown_objects[i])) {
+            placed_kept[i] = shown_kept[i] = true;
+            shown_idx[i] = i;
+        } else {
+            placed_rest.push_back(i);
+        }
+    }
+    for (int j = 0; j < m; j++) {
+        if (!shown_kept[j]) {
+            shown_rest.push_back(j);
+        }
+    }
+    if (!placed_rest.empty() && !shown_rest.empty()) {
+        auto before = [](const struct placed_object &a, const struct placed_object &b) {
+            return std::tie(a.rect.x, a.rect.y, a.rect.w, a.rect.h, a.pixels) <
+                   std::tie(b.rect.x, b.rect.y, b.rect.w, b.rect.h, b.pixels);
+        };
+        std::sort(placed_rest.begin(), placed_rest.end(), 
+                  [&](int a, int b) { return before(placed_objects[a], placed_objects[b]); });
+        std::sort(shown_rest.begin(), shown_rest.end(), 
+                  [&](int a, int b) { return before(shown_objects[a], shown_objects[b]); });
+        for (size_t i = 0, j = 0; i < placed_rest.size() && j < shown_rest.size(); ) {
+            const struct placed_object &a = placed_objects[placed_rest[i]];
+            const struct placed_object &b = shown_objects[shown_rest[j]];
+            if (before(a, b)) {
+                i++;
+            } else if (before(b, a)) {
+                j++;
+            } else {
+                shown_idx[placed_rest[i]] = shown_rest[j];
+                placed_kept[placed_rest[i++]] = shown_kept[shown_rest[j++]] = true;
+            }
+        }
+    }
+
+    // erase the shown objects that weren't placed again, noting the tiles that 
+    // they and the new objects are in, the tiles of kept objects that are now 
+    // drawn in a different order, and the tiles whose static pixels have changed
+    std::unordered_set<int> touched;
+    touched.swap(static_changed_tiles);
+    auto touch = [&](const struct rect &r) {
+        for (int y = r.y & ~TILE_MASK; y < r.y+r.h; y += TILE_SIZE) {
+            for (int x = r.x & ~TILE_MASK; x < r.x+r.w; x += TILE_SIZE) {
+                touched.insert(tile_index(x,y));
+            }
+        }
+    };
+    auto touches = [&](const struct rect &r) {
+        if (touched.empty()) {
+            return false;
+        }
+        for (int y = r.y & ~TILE_MASK; y < r.y+r.h; y += TILE_SIZE) {
+            for (int x = r.x & ~TILE_MASK; x < r.x+r.w; x += TILE_SIZE) {
+                if (touched.count(tile_index(x,y))) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    };
+    for (int j = 0; j < m; j++) {
+        if (!shown_kept[j]) {
+            erase_object(shown_objects[j]);
+            touch(shown_objects[j].rect);
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        if (!placed_kept[i] || shown_idx[i] != i) {
+            touch(placed_objects[i].rect);
+        }
+    }
+
+    // draw, in order, the new objects and the kept objects that share a tile with
+    // an object that was erased or drawn; a redrawn object's tiles are touched,
+    // so that the objects after it that overlap it are drawn on top of it again
+    for (int i = 0; i < n; i++) {
+        if (!placed_kept[i] || touches(placed_objects[i].rect)) {
+            draw_object(placed_objects[i], !placed_kept[i]);
+            touch(placed_objects[i].rect);
+        }
+    }
 
-    // copy non transparent object pixels to pixels
-    for (y = rect.y; y < rect.y+rect.h; y++) {
-        for (x = rect.x; x < rect.x+rect.w; x++) {
-            if (*p != display::TRANSPARENT) {
-                pixels[y][x] = *p;
+    shown_objects = placed_objects;
+    objects_pending = false;
+}
+
+// forgets the placed and shown objects, when the dynamic layer is reset
+void world::forget_objects()
+{
+    placed_objects.clear();
+    shown_objects.clear();
+    tile_objects.clear();
+    static_changed_tiles.clear();
+    objects_pending = false;
+}
+
+// restores the dynamic layer's pixels under an object from the static layer; a 
+// tiled world's tile that no longer has any objects is given back the static 
+// layer's slot
+void world::erase_object(const struct placed_object &obj)
+{
+    const struct rect &rect = obj.rect;
+
+    if (layout == WORLD_LINEAR) {
+        for (int y = rect.y; y < rect.y+rect.h; y++) {
+            long offset = linear_offset(rect.x,y);
+            memcpy(&pixels[offset], &static_pixels[offset], rect.w);
+        }
+    } else {
+        for (int ty = rect.y & ~TILE_MASK; ty < rect.y+rect.h; ty += TILE_SIZE) {
+            for (int tx = rect.x & ~TILE_MASK; tx < rect.x+rect.w; tx += TILE_SIZE) {
+                int t = tile_index(tx,ty);
+                auto it = tile_objects.find(t);
+                assert(it != tile_objects.end());
+                if (--it->second == 0) {
+                    tile_objects.erase(it);
+                    if (tile_dir[t] != static_tile_dir[t]) {
+                        free_tile_slots.push_back(tile_dir[t]);
+                        tile_dir[t] = static_tile_dir[t];
+                    }
+                    continue;
+                }
+
+                int x1 = std::max(rect.x, tx), x2 = std::min(rect.x+rect.w, tx+TILE_SIZE);
+                int y1 = std::max(rect.y, ty), y2 = std::min(rect.y+rect.h, ty+TILE_SIZE);
+                unsigned char * tile = writable_tile(DYNAMIC_LAYER, t);
+                for (int y = y1; y < y2; y++) {
+                    memcpy(&tile[(y & TILE_MASK) << TILE_SHIFT | (x1 & TILE_MASK)], 
+                           pixel_ptr(STATIC_LAYER, x1, y), x2 - x1);
+                }
             }
-            p++;
         }
     }
 
-    // update the texture
-    d.texture_set_rect(texture, 
-                       rect.x, rect.y, rect.w, rect.h, 
-                       &pixels[rect.y][rect.x], 
-                       WORLD_WIDTH);
+    // the texture is updated when the world is next drawn
+    add_dirty_rect(rect.x, rect.y, rect.w, rect.h);
+}
+
+// copies an object's non transparent pixels to the dynamic layer
+void world::draw_object(const struct placed_object &obj, bool is_new)
+{
+    const struct rect &rect = obj.rect;
+    const unsigned char * p = obj.pixels;
+    const unsigned char * mask = obj.mask;
+    std::vector<unsigned char> mask_buff;
+
+    if (layout == WORLD_TILED && is_new) {
+        for (int y = rect.y & ~TILE_MASK; y < rect.y+rect.h; y += TILE_SIZE) {
+            for (int x = rect.x & ~TILE_MASK; x < rect.x+rect.w; x += TILE_SIZE) {
+                tile_objects[tile_index(x,y)]++;
+            }
+        }
+    }
+
+    if (mask == NULL) {
+        mask_buff.resize(rect.w * rect.h);
+        for (int i = 0; i < rect.w * rect.h; i++) {
+            mask_buff[i] = -(p[i] != display::TRANSPARENT);
+        }
+        mask = &mask_buff[0];
+    }
+
+    for (int y = rect.y; y < rect.y+rect.h; y++, p += rect.w, mask += rect.w) {
+        if (layout == WORLD_LINEAR) {
+            blend_row(&pixels[linear_offset(rect.x,y)], p, mask, rect.w);
+            continue;
+        }
+        for (int x = rect.x, len; x < rect.x+rect.w; x += len) {
+            len = row_run(x, rect.x+rect.w-x);
+            unsigned char * tile = writable_tile(DYNAMIC_LAYER, tile_index(x,y));
+            blend_row(&tile[(y & TILE_MASK) << TILE_SHIFT | (x & TILE_MASK)], 
+                      &p[x-rect.x], &mask[x-rect.x], len);
+        }
+    }
+
+    // the texture is updated when the world is next drawn
+    if (is_new) {
+        add_dirty_rect(rect.x, rect.y, rect.w, rect.h);
+    }
 }
 
 void world::draw(int pid, int center_x_arg, int center_y_arg, double zoom_arg)
 {
     int w, h, x, y;
 
-    w = WORLD_WIDTH / zoom_arg;
-    h = WORLD_HEIGHT / zoom_arg;
+    w = width / zoom_arg;
+    h = height / zoom_arg;
     x = center_x_arg - w/2;
     y = center_y_arg - h/2;
 
-    d.texture_draw1(texture, x, y, w, h, pid);
+    show_placed_objects();
+    flush_texture();
+    d.texture_draw1(texture, x / texture_scale, y / texture_scale, w / texture_scale, h / texture_scale, pid);
 
     center_x = center_x_arg;
     center_y = center_y_arg;
@@ -160,114 +649,1353 @@ void world::draw(int pid, int center_x_arg, int center_y_arg, double zoom_arg)
 
 void world::get_view(int x, int y, double dir, int W, int H, unsigned char * p)
 {
-    int d = sanitize_direction(round(dir));
+    struct view_origin vo;
 
-    assert(d >= 0 && d <= 359);
+    init_view_origin(vo, x, y, dir, W, H);
+    for (int h = H-1; h >= 0; h--) {
+        get_view_row(vo, h, -W/2, W, p);
+        p += W;
+    }
+}
+
+// A view origin holds what's needed to sample any part of the view that 
+// get_view would return for the same arguments; get_view_segment then samples
+// n pixels of the view's row starting at col, where row 0 is the far end of 
+// the view as in get_view's output. This lets callers that look at a small 
+// part of the view sample only that part.
+void world::init_view_origin(struct view_origin &vo, int x, int y, double dir, int W, int H)
+{
     assert(H <= MAX_GET_VIEW_XY);
     assert(W <= MAX_GET_VIEW_XY);
 
-    for (int h = H-1; h >= 0; h--) {
-        for (int w = -W/2; w < -W/2+W; w++) {
-            int dx = get_view_dx_tbl[d][h][w+(MAX_GET_VIEW_XY/2)];
-            int dy = get_view_dy_tbl[d][h][w+(MAX_GET_VIEW_XY/2)];
-            if (y+dy >= 0 && y+dy < WORLD_HEIGHT && x+dx >= 0 && x+dx < WORLD_WIDTH) {
-                *p++ = pixels[y+dy][x+dx];
-            } else {
-                *p++ = display::PURPLE;
+    show_placed_objects();
+
+    vo.x = x;
+    vo.y = y;
+    vo.W = W;
+    vo.H = H;
+
+    // views that stay within the guard band, which is all views except those
+    // of cars near the edge of the world, are sampled without bounds checks
+    vo.checked = !get_view_in_guard_band(x, y, W, H);
+
+    // sub-degree headings are always sampled by stepping, using coefficients 
+    // for the exact direction
+    if (get_view_sampling != GET_VIEW_WHOLE_DEGREE) {
+        vo.sampler = (get_view_sampling == GET_VIEW_BILINEAR ? VIEW_BILINEAR : VIEW_STEP);
+        vo.d = 0;
+        init_get_view_coeff(sanitize_direction(dir), vo.c);
+        return;
+    }
+
+    vo.d = sanitize_direction(round(dir));
+    assert(vo.d >= 0 && vo.d <= 359);
+    vo.c = get_view_coeff_tbl[vo.d];
+    vo.sampler = (get_view_engine == GET_VIEW_TABLE ? VIEW_TABLE : VIEW_STEP);
+}
+
+void world::get_view_segment(const struct view_origin &vo, int row, int col, int n, unsigned char * p)
+{
+    assert(row >= 0 && row < vo.H);
+    assert(col >= 0 && col + n <= vo.W);
+
+    get_view_row(vo, vo.H-1-row, col - vo.W/2, n, p);
+}
+
+// samples view row h (distance ahead), for w (distance to the right) from w0 to w0+n-1
+void world::get_view_row(const struct view_origin &vo, int h, int w0, int n, unsigned char * p)
+{
+    if (vo.sampler == VIEW_TABLE) {
+        get_view_table_row(vo.x, vo.y, vo.d, h, w0, n, vo.checked, p);
+    } else if (vo.sampler == VIEW_BILINEAR) {
+        get_view_bilinear_row(vo.x, vo.y, vo.c, h, w0, n, vo.checked, p);
+    } else {
+        get_view_step_row(vo.x, vo.y, vo.c, h, w0, n, vo.checked, p);
+    }
+}
+
+// returns true if every pixel of a W x H view from x,y, at any heading, is 
+// within the world or its guard band; the reach includes 1 pixel for the 
+// bilinear sampler's second tap, and 1 for rounding
+bool world::get_view_in_guard_band(int x, int y, int W, int H)
+{
+    int reach = sqrt((W/2)*(W/2) + H*H) + 2;
+    int side_guard = (layout == WORLD_LINEAR ? 0 : WORLD_GUARD);
+
+    return x - reach >= -side_guard && x + reach < width + side_guard &&
+           y - reach >= -WORLD_GUARD && y + reach < height + WORLD_GUARD;
+}
+
+void world::get_view_table_row(int x, int y, int d, int h, int w0, int len, bool checked, unsigned char * p)
+{
+    // the view offsets are the base heading's offsets, taken from column -w 
+    // instead of w and with dx negated when mirrored, then turned by quarter turns;
+    // dx = mxx*bx + mxy*by and dy = myx*bx + myy*by
+    static const int quarter_turn[4][4] = { {1,0,0,1}, {0,-1,1,0}, {-1,0,0,-1}, {0,1,-1,0} };
+    int quarter;
+    bool mirror;
+
+    const struct get_view_coeff &c = get_view_coeff_tbl[d];
+    if (!c.folds_exactly) {
+        for (int w = w0; w < w0+len; w++) {
+            short dx = w * c.cosdir + h * c.sindir;
+            short dy = w * c.sindir - h * c.cosdir;
+            *p++ = checked ? get_view_pixel(x+dx, y+dy) : pixel(x+dx, y+dy);
+        }
+        return;
+    }
+
+    int b = fold_direction(d, quarter, mirror);
+    if (!get_view_tbl_built[b]) {
+        init_get_view_tbl(b);
+    }
+
+    int m   = mirror ? -1 : 1;
+    int mxx = m * quarter_turn[quarter][0];
+    int mxy = quarter_turn[quarter][1];
+    int myx = m * quarter_turn[quarter][2];
+    int myy = quarter_turn[quarter][3];
+
+    const short * bx = &get_view_dx_tbl[b][h][m*w0+(MAX_GET_VIEW_XY/2)];
+    const short * by = &get_view_dy_tbl[b][h][m*w0+(MAX_GET_VIEW_XY/2)];
+    for (int i = 0; i < len; i++, bx += m, by += m) {
+        int dx = mxx * *bx + mxy * *by;
+        int dy = myx * *bx + myy * *by;
+        *p++ = checked ? get_view_pixel(x+dx, y+dy) : pixel(x+dx, y+dy);
+    }
+}
+
+// returns the number of steps, at most n, for which v + i*step stays on the 
+// same side of zero as v 
+static inline int same_sign_steps(long v, long step, int n)
+{
+    long k;
+
+    if (v < 0 && step > 0) {
+        k = (-v + step - 1) / step;
+    } else if (v >= 0 && step < 0) {
+        k = v / -step + 1;
+    } else {
+        return n;
+    }
+    return k < n ? k : n;
+}
+
+#if defined(__x86_64__)
+// returns the high 32 bits of the 64 bit lanes of a (lanes 0-3) and b (lanes 4-7)
+__attribute__((target("avx2")))
+static inline __m256i high_dwords(__m256i a, __m256i b)
+{
+    __m256i r = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(a), 
+                                                      _mm256_castsi256_ps(b),
+                                                      _MM_SHUFFLE(3,1,3,1)));
+    return _mm256_permute4x64_epi64(r, _MM_SHUFFLE(3,1,2,0));
+}
+
+// widens the 8 unsigned dwords of v to 64 bit lanes, lanes 0-3 to lo and 4-7 to hi
+__attribute__((target("avx2")))
+static inline void widen_dwords(__m256i v, __m256i &lo, __m256i &hi)
+{
+    lo = _mm256_cvtepu32_epi64(_mm256_castsi256_si128(v));
+    hi = _mm256_cvtepu32_epi64(_mm256_extracti128_si256(v, 1));
+}
+
+// gathers the dwords at base plus the 64 bit byte offsets lo (lanes 0-3) and 
+// hi (lanes 4-7), for the lanes set in mask; the other lanes are taken from src
+__attribute__((target("avx2")))
+static inline __m256i gather_dwords_i64(__m256i src, const unsigned char * base, __m256i lo, __m256i hi,
+                                        __m256i mask)
+{
+    const int * b = reinterpret_cast<const int*>(base);
+    __m128i a = _mm256_mask_i64gather_epi32(_mm256_castsi256_si128(src), b, lo, 
+                                            _mm256_castsi256_si128(mask), 1);
+    __m128i c = _mm256_mask_i64gather_epi32(_mm256_extracti128_si256(src, 1), b, hi, 
+                                            _mm256_extracti128_si256(mask, 1), 1);
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(a), c, 1);
+}
+
+// AVX2 version of the step engine's inner loop, for a run of n view pixels that
+// share a rounding bias. Each iteration does 8 pixels: the world coordinates are
+// the high halves of the 32.32 lanes, pixels off the world are masked out of the
+// gather and left PURPLE, and the low byte of each gathered dword is stored;
+// a tiled world takes a second gather, of the tiles' slots, first. Pixel offsets
+// can pass 2^31, in a large linear world or tile pool, so they're gathered with
+// 64 bit offsets.
+// Returns the number of pixels done, a multiple of 8; the caller does the rest.
+int world::get_view_run_avx2(long ax, long ay, long cos_fp, long sin_fp, int n, unsigned char * p)
+{
+    __m256i xa = _mm256_setr_epi64x(ax, ax + cos_fp, ax + 2*cos_fp, ax + 3*cos_fp);
+    __m256i ya = _mm256_setr_epi64x(ay, ay + sin_fp, ay + 2*sin_fp, ay + 3*sin_fp);
+    __m256i xb = _mm256_add_epi64(xa, _mm256_set1_epi64x(4*cos_fp));
+    __m256i yb = _mm256_add_epi64(ya, _mm256_set1_epi64x(4*sin_fp));
+
+    const __m256i step_x    = _mm256_set1_epi64x(8*cos_fp);
+    const __m256i step_y    = _mm256_set1_epi64x(8*sin_fp);
+    const __m256i stride    = _mm256_set1_epi32(layout == WORLD_LINEAR ? width : tiles_per_row);
+    const __m256i guard     = _mm256_set1_epi32(WORLD_GUARD);
+    const __m256i tile_mask = _mm256_set1_epi32(TILE_MASK);
+    const __m256i max_x     = _mm256_set1_epi32(width-1);
+    const __m256i max_y     = _mm256_set1_epi32(height-1);
+    const __m256i purple    = _mm256_set1_epi32(display::PURPLE);
+    const __m256i low_bytes = _mm256_setr_epi8(0,4,8,12, -1,-1,-1,-1, -1,-1,-1,-1, -1,-1,-1,-1,
+                                               0,4,8,12, -1,-1,-1,-1, -1,-1,-1,-1, -1,-1,-1,-1);
+    const __m256i pack      = _mm256_setr_epi32(0,4, 0,0,0,0,0,0);
+
+    int i;
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256i wx = high_dwords(xa, xb);
+        __m256i wy = high_dwords(ya, yb);
+
+        // unsigned compare, so negative coordinates are off the world too
+        __m256i on_world = _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_min_epu32(wx, max_x), wx),
+                                            _mm256_cmpeq_epi32(_mm256_min_epu32(wy, max_y), wy));
+        // pixel offsets, same as linear_offset and tiled_offset
+        __m256i gx = _mm256_add_epi32(wx, guard);
+        __m256i gy = _mm256_add_epi32(wy, guard);
+        __m256i px;
+        if (layout == WORLD_LINEAR) {
+            __m256i gy_lo, gy_hi, wx_lo, wx_hi;
+            widen_dwords(gy, gy_lo, gy_hi);
+            widen_dwords(wx, wx_lo, wx_hi);
+            __m256i idx_lo = _mm256_add_epi64(_mm256_mul_epu32(gy_lo, stride), wx_lo);
+            __m256i idx_hi = _mm256_add_epi64(_mm256_mul_epu32(gy_hi, stride), wx_hi);
+            px = gather_dwords_i64(purple, pixels, idx_lo, idx_hi, on_world);
+        } else {
+            __m256i tile = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srli_epi32(gy, TILE_SHIFT), stride), 
+                                            _mm256_srli_epi32(gx, TILE_SHIFT));
+            __m256i slot = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), 
+                                                       reinterpret_cast<const int*>(tile_dir), tile, on_world, 4);
+            __m256i in_tile = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(wy, tile_mask), TILE_SHIFT),
+                                              _mm256_and_si256(wx, tile_mask));
+            __m256i slot_lo, slot_hi, in_tile_lo, in_tile_hi;
+            widen_dwords(slot, slot_lo, slot_hi);
+            widen_dwords(in_tile, in_tile_lo, in_tile_hi);
+            __m256i idx_lo = _mm256_or_si256(_mm256_slli_epi64(slot_lo, 2*TILE_SHIFT), in_tile_lo);
+            __m256i idx_hi = _mm256_or_si256(_mm256_slli_epi64(slot_hi, 2*TILE_SHIFT), in_tile_hi);
+            px = gather_dwords_i64(purple, tile_pool, idx_lo, idx_hi, on_world);
+        }
+
+        px = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(px, low_bytes), pack);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(p+i), _mm256_castsi256_si128(px));
+
+        xa = _mm256_add_epi64(xa, step_x);
+        xb = _mm256_add_epi64(xb, step_x);
+        ya = _mm256_add_epi64(ya, step_y);
+        yb = _mm256_add_epi64(yb, step_y);
+    }
+    return i;
+}
+#endif
+
+// The step engine walks a view row in 32.32 fixed point, starting at the
+// row's left end and adding the heading's cosine and sine per column. The
+// offsets are truncated toward zero, same as the rotation tables; the row is
+// split where an offset changes sign so that each run uses a constant 
+// rounding bias, and the run's world coordinate is then just a shift.
+void world::get_view_step_row(int x, int y, const struct get_view_coeff &c, int h, int w0, int len, 
+                              bool checked, unsigned char * p)
+{
+    const long FRAC_MASK = (1L << GET_VIEW_FP_SHIFT) - 1;
+
+    if (c.eval_in_double) {
+        for (int w = w0; w < w0+len; w++) {
+            int dx = w * c.cosdir + h * c.sindir;
+            int dy = w * c.sindir - h * c.cosdir;
+            *p++ = checked ? get_view_pixel(x+dx, y+dy) : pixel(x+dx, y+dy);
+        }
+        return;
+    }
+
+    long vx = w0 * c.cos_fp + h * c.sin_fp;
+    long vy = w0 * c.sin_fp - h * c.cos_fp;
+    int  w  = 0;
+
+    while (w < len) {
+        int n = same_sign_steps(vx, c.cos_fp, len - w);
+        n = same_sign_steps(vy, c.sin_fp, n);
+
+        long ax = ((long)x << GET_VIEW_FP_SHIFT) + vx + (vx < 0 ? FRAC_MASK : 0);
+        long ay = ((long)y << GET_VIEW_FP_SHIFT) + vy + (vy < 0 ? FRAC_MASK : 0);
+        int  i  = 0;
+#if defined(__x86_64__)
+        if (get_view_avx2 && n >= 8) {
+            i = get_view_run_avx2(ax, ay, c.cos_fp, c.sin_fp, n, p);
+            p  += i;
+            ax += i * c.cos_fp;
+            ay += i * c.sin_fp;
+        }
+#endif
+        if (checked) {
+            for (; i < n; i++) {
+                *p++ = get_view_pixel(ax >> GET_VIEW_FP_SHIFT, ay >> GET_VIEW_FP_SHIFT);
+                ax += c.cos_fp;
+                ay += c.sin_fp;
+            }
+        } else if (layout == WORLD_LINEAR) {
+            const unsigned char * origin = &pixels[linear_offset(0,0)];
+            for (; i < n; i++) {
+                *p++ = origin[(ay >> GET_VIEW_FP_SHIFT) * width + (ax >> GET_VIEW_FP_SHIFT)];
+                ax += c.cos_fp;
+                ay += c.sin_fp;
+            }
+        } else {
+            for (; i < n; i++) {
+                *p++ = tile_pool[tiled_offset(tile_dir, ax >> GET_VIEW_FP_SHIFT, ay >> GET_VIEW_FP_SHIFT)];
+                ax += c.cos_fp;
+                ay += c.sin_fp;
+            }
+        }
+
+        vx += n * c.cos_fp;
+        vy += n * c.sin_fp;
+        w  += n;
+    }
+}
+
+// returns the color of px00..px11 having the largest total bilinear weight, 
+// for a sample point fx,fy (in 1/256ths) to the right of and below px00
+static inline unsigned char bilinear_vote(unsigned char px00, unsigned char px01, 
+                                          unsigned char px10, unsigned char px11, 
+                                          int fx, int fy)
+{
+    int w00 = (256-fx) * (256-fy);
+    int w01 = fx * (256-fy);
+    int w10 = (256-fx) * fy;
+    int w11 = fx * fy;
+
+    // total weight of each tap's color
+    int t00 = w00 + (px01 == px00) * w01 + (px10 == px00) * w10 + (px11 == px00) * w11;
+    int t01 = w01 + (px00 == px01) * w00 + (px10 == px01) * w10 + (px11 == px01) * w11;
+    int t10 = w10 + (px00 == px10) * w00 + (px01 == px10) * w01 + (px11 == px10) * w11;
+    int t11 = w11 + (px00 == px11) * w00 + (px01 == px11) * w01 + (px10 == px11) * w10;
+
+    unsigned char best = px00;
+    int best_weight = t00;
+    if (t01 > best_weight) {
+        best = px01;
+        best_weight = t01;
+    }
+    if (t10 > best_weight) {
+        best = px10;
+        best_weight = t10;
+    }
+    if (t11 > best_weight) {
+        best = px11;
+        best_weight = t11;
+    }
+    return best;
+}
+
+// The bilinear sampler places each view pixel at its exact rotated position
+// and weights the four world pixels around it by distance. World pixels are 
+// colors, not intensities, so rather than being blended the view pixel gets 
+// the color with the largest total weight.
+void world::get_view_bilinear_row(int x, int y, const struct get_view_coeff &c, int h, int w0, int len, 
+                                  bool checked, unsigned char * p)
+{
+    long ax = ((long)x << GET_VIEW_FP_SHIFT) + w0 * c.cos_fp + h * c.sin_fp;
+    long ay = ((long)y << GET_VIEW_FP_SHIFT) + w0 * c.sin_fp - h * c.cos_fp;
+
+    for (int i = 0; i < len; i++) {
+        int x0 = ax >> GET_VIEW_FP_SHIFT;
+        int y0 = ay >> GET_VIEW_FP_SHIFT;
+        unsigned char px00, px01, px10, px11;
+        if (checked) {
+            px00 = get_view_pixel(x0,   y0);
+            px01 = get_view_pixel(x0+1, y0);
+            px10 = get_view_pixel(x0,   y0+1);
+            px11 = get_view_pixel(x0+1, y0+1);
+        } else {
+            px00 = pixel(x0,   y0);
+            px01 = pixel(x0+1, y0);
+            px10 = pixel(x0,   y0+1);
+            px11 = pixel(x0+1, y0+1);
+        }
+
+        // most samples are inside a uniform area, where there is nothing to weigh
+        if (px00 == px01 && px00 == px10 && px00 == px11) {
+            *p++ = px00;
+        } else {
+            *p++ = bilinear_vote(px00, px01, px10, px11,
+                                 (ax >> (GET_VIEW_FP_SHIFT-8)) & 255,
+                                 (ay >> (GET_VIEW_FP_SHIFT-8)) & 255);
+        }
+
+        ax += c.cos_fp;
+        ay += c.sin_fp;
+    }
+}
+
+// -----------------  WORLD PIXEL LAYOUT  -------------------------------------------
+
+// copies n pixels of row y of a layer, starting at x, to dst
+void world::copy_row_out(enum layer l, int x, int y, int n, unsigned char * dst)
+{
+    for (int len; n > 0; x += len, dst += len, n -= len) {
+        len = row_run(x, n);
+        memcpy(dst, pixel_ptr(l,x,y), len);
+    }
+}
+
+// maps a raw world file, or anonymous memory if fd is -1, over the world rows
+// of the linear layers; the file is mapped shared and read only for the static
+// layer, and private for the dynamic layer. on failure the world rows are
+// left as anonymous memory, whose contents are lost either way
+bool world::map_world_rows(int fd)
+{
+    long len = (long)width * height;
+    void * addr1 = MAP_FAILED;
+    void * addr2 = MAP_FAILED;
+
+    forget_objects();
+
+    if (fd >= 0) {
+        addr1 = mmap(&static_pixels[linear_offset(0,0)], len, PROT_READ, MAP_SHARED|MAP_FIXED, fd, 0);
+        addr2 = mmap(&pixels[linear_offset(0,0)], len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED, fd, 0);
+        if (addr1 != MAP_FAILED && addr2 != MAP_FAILED) {
+            static_mapped = true;
+            return true;
+        }
+    }
+
+    addr1 = mmap(&static_pixels[linear_offset(0,0)], len, PROT_READ|PROT_WRITE, 
+                 MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED, -1, 0);
+    addr2 = mmap(&pixels[linear_offset(0,0)], len, PROT_READ|PROT_WRITE, 
+                 MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED, -1, 0);
+    if (addr1 == MAP_FAILED || addr2 == MAP_FAILED) {
+        FATAL("mmap world rows, " << strerror(errno) << endl);
+    }
+    static_mapped = false;
+    return fd < 0;
+}
+
+// loads TILE_SIZE rows of the world, starting at row y, into both layers; 
+// src is row major, width pixels wide. a linear world's rows must not be a 
+// mapped file, and a tiled world must have been reset first; tiles that are
+// a single color are given that color's uniform slot
+void world::load_rows(int y, const unsigned char * src)
+{
+    assert((y & TILE_MASK) == 0);
+
+    if (layout == WORLD_LINEAR) {
+        memcpy(&static_pixels[linear_offset(0,y)], src, (long)TILE_SIZE*width);
+        memcpy(&pixels[linear_offset(0,y)], src, (long)TILE_SIZE*width);
+        return;
+    }
+
+    for (int x = 0; x < width; x += TILE_SIZE) {
+        const unsigned char * s = &src[x];
+        bool uniform = true;
+        for (int i = 0; i < TILE_SIZE && uniform; i++) {
+            for (int j = 0; j < TILE_SIZE; j++) {
+                if (s[(long)i*width+j] != s[0]) {
+                    uniform = false;
+                    break;
+                }
+            }
+        }
+
+        unsigned int slot;
+        if (uniform) {
+            slot = uniform_tile_slot(s[0]);
+        } else {
+            slot = alloc_tile_slot();
+            for (int i = 0; i < TILE_SIZE; i++) {
+                memcpy(&tile_pool[(long)slot*TILE_BYTES + i*TILE_SIZE], &s[(long)i*width], TILE_SIZE);
             }
         }
+
+        int t = tile_index(x,y);
+        static_tile_dir[t] = slot;
+        tile_dir[t] = slot;
+    }
+}
+
+// sets every tile of a tiled world to its uniform slot, GREEN for the static
+// layer and PURPLE for the dynamic layer's guard band, and frees all other slots; 
+// their pages are given back to the system
+void world::reset_tiles()
+{
+    int tile_rows = buff_height / TILE_SIZE;
+    int guard_tiles = WORLD_GUARD / TILE_SIZE;
+
+    forget_objects();
+    for (int ty = 0; ty < tile_rows; ty++) {
+        for (int tx = 0; tx < tiles_per_row; tx++) {
+            bool on_world = tx >= guard_tiles && tx < tiles_per_row - guard_tiles &&
+                            ty >= guard_tiles && ty < tile_rows - guard_tiles;
+            int t = ty * tiles_per_row + tx;
+            static_tile_dir[t] = uniform_tile_slot(display::GREEN);
+            tile_dir[t] = on_world ? static_tile_dir[t] : uniform_tile_slot(display::PURPLE);
+        }
+    }
+
+    if (next_tile_slot > UNIFORM_TILE_SLOTS) {
+        madvise(&tile_pool[(long)UNIFORM_TILE_SLOTS*TILE_BYTES], 
+                (long)(next_tile_slot-UNIFORM_TILE_SLOTS)*TILE_BYTES, MADV_DONTNEED);
+    }
+    next_tile_slot = UNIFORM_TILE_SLOTS;
+    free_tile_slots.clear();
+}
+
+unsigned int world::alloc_tile_slot()
+{
+    if (!free_tile_slots.empty()) {
+        unsigned int slot = free_tile_slots.back();
+        free_tile_slots.pop_back();
+        return slot;
+    }
+    // a static tile has at most one slot of its own, and a dynamic tile one more,
+    // which is freed when its objects are gone; so there's always a slot
+    assert(next_tile_slot < max_tile_slots);
+    return next_tile_slot++;
+}
+
+unsigned int world::uniform_tile_slot(unsigned char c)
+{
+    if (!uniform_tile_ready[c]) {
+        memset(&tile_pool[(long)c*TILE_BYTES], c, TILE_BYTES);
+        uniform_tile_ready[c] = true;
+    }
+    return c;
+}
+
+// returns tile t of a layer, first copying it to a slot of its own if the slot
+// is shared; a static tile's slot may be shared with the dynamic layer, that's 
+// up to the caller
+unsigned char * world::writable_tile(enum layer l, int t)
+{
+    unsigned int &slot = (l == STATIC_LAYER ? static_tile_dir[t] : tile_dir[t]);
+
+    if (slot < UNIFORM_TILE_SLOTS || (l == DYNAMIC_LAYER && slot == static_tile_dir[t])) {
+        unsigned int new_slot = alloc_tile_slot();
+        memcpy(&tile_pool[(long)new_slot*TILE_BYTES], &tile_pool[(long)slot*TILE_BYTES], TILE_BYTES);
+        slot = new_slot;
     }
+    return &tile_pool[(long)slot*TILE_BYTES];
+}
+
+// creates the world texture from the static layer; the texture needs row major 
+// pixels, so a tiled world is first copied out. worlds larger than MAX_TEXTURE_SIZE
+// get a texture that's scaled down by texture_scale, by sampling every 
+// texture_scale'th pixel
+void world::create_texture()
+{
+    int s  = texture_scale;
+    int tw = (width + s - 1) / s;
+    int th = (height + s - 1) / s;
+
+    d.texture_destroy(texture);
+    dirty_rects.clear();
+
+    if (layout == WORLD_LINEAR && s == 1) {
+        texture = d.texture_create(&static_pixels[linear_offset(0,0)], width, height, width);
+        return;
+    }
+
+    unsigned char * p = new unsigned char [(long)tw*th];
+    for (int y = 0; y < th; y++) {
+        if (s == 1) {
+            copy_row_out(STATIC_LAYER, 0, y, width, &p[(long)y*tw]);
+            continue;
+        }
+        for (int x = 0; x < tw; x++) {
+            p[(long)y*tw+x] = *pixel_ptr(STATIC_LAYER, x*s, y*s);
+        }
+    }
+    texture = d.texture_create(p, tw, th, tw);
+    delete [] p;
+}
+
+// updates a rect of the world texture from the dynamic layer
+void world::update_texture(int x, int y, int w, int h)
+{
+    int s = texture_scale;
+
+    if (layout == WORLD_LINEAR && s == 1) {
+        d.texture_set_rect(texture, x, y, w, h, &pixels[linear_offset(x,y)], width);
+        return;
+    }
+
+    // the texture pixels whose samples are in the rect
+    int tx = (x + s - 1) / s;
+    int ty = (y + s - 1) / s;
+    int tw = (x + w - 1) / s - tx + 1;
+    int th = (y + h - 1) / s - ty + 1;
+    if (tw <= 0 || th <= 0) {
+        return;
+    }
+
+    if ((long)texture_buff.size() < (long)tw*th) {
+        texture_buff.resize((long)tw*th);
+    }
+    unsigned char * p = &texture_buff[0];
+    for (int i = 0; i < th; i++) {
+        if (s == 1) {
+            copy_row_out(DYNAMIC_LAYER, x, y+i, w, &p[i*w]);
+            continue;
+        }
+        for (int j = 0; j < tw; j++) {
+            p[i*tw+j] = pixel((tx+j)*s, (ty+i)*s);
+        }
+    }
+    d.texture_set_rect(texture, tx, ty, tw, th, p, tw);
+}
+
+// records that a rect of the texture is out of date; if the world isn't drawn for
+// a long while the rects are merged, and failing that replaced by their bounding 
+// rect, so that they don't grow without limit
+void world::add_dirty_rect(int x, int y, int w, int h)
+{
+    struct rect r = { x, y, w, h };
+
+    dirty_rects.push_back(r);
+    if ((int)dirty_rects.size() < MAX_DIRTY_RECTS) {
+        return;
+    }
+
+    merge_dirty_rects();
+    if ((int)dirty_rects.size() < MAX_DIRTY_RECTS / 2) {
+        return;
+    }
+
+    int x1 = width, y1 = height, x2 = 0, y2 = 0;
+    for (auto &r : dirty_rects) {
+        x1 = std::min(x1, r.x);
+        y1 = std::min(y1, r.y);
+        x2 = std::max(x2, r.x + r.w);
+        y2 = std::max(y2, r.y + r.h);
+    }
+    dirty_rects.clear();
+    r = { x1, y1, x2 - x1, y2 - y1 };
+    dirty_rects.push_back(r);
+}
+
+// replaces dirty rects that overlap or touch with their bounding rect; an object's 
+// rect from the last frame mostly overlaps its rect for this frame, so this about 
+// halves the uploads. the rects are sorted by x, so each rect need only be checked
+// against the rects that follow it and start before its right edge.
+void world::merge_dirty_rects()
+{
+    bool merged = true;
+
+    while (merged) {
+        merged = false;
+        std::sort(dirty_rects.begin(), dirty_rects.end(),
+                  [](const struct rect &a, const struct rect &b) { return a.x < b.x; });
+
+        int n = dirty_rects.size();
+        for (int i = 0; i < n; i++) {
+            struct rect &a = dirty_rects[i];
+            if (a.w == 0) {
+                continue;
+            }
+            for (int j = i+1; j < n && dirty_rects[j].x <= a.x + a.w; j++) {
+                struct rect &b = dirty_rects[j];
+                if (b.w == 0 || b.y > a.y + a.h || a.y > b.y + b.h) {
+                    continue;
+                }
+                int x2 = std::max(a.x + a.w, b.x + b.w);
+                int y1 = std::min(a.y, b.y);
+                int y2 = std::max(a.y + a.h, b.y + b.h);
+                a.y = y1;
+                a.w = x2 - a.x;
+                a.h = y2 - y1;
+                b.w = 0;
+                merged = true;
+            }
+        }
+
+        dirty_rects.erase(std::remove_if(dirty_rects.begin(), dirty_rects.end(),
+                                         [](const struct rect &r) { return r.w == 0; }),
+                          dirty_rects.end());
+    }
+}
+
+// uploads the dirty rects of the texture
+void world::flush_texture()
+{
+    merge_dirty_rects();
+    for (auto &r : dirty_rects) {
+        update_texture(r.x, r.y, r.w, r.h);
+    }
+    dirty_rects.clear();
 }
 
 // -----------------  MISC  ---------------------------------------------------------
 
 void world::clear()
 {
-    memset(static_pixels, display::GREEN, WORLD_WIDTH*WORLD_HEIGHT); 
-    memcpy(pixels, static_pixels, WORLD_WIDTH*WORLD_HEIGHT);
-    d.texture_destroy(texture);
-    texture = d.texture_create(reinterpret_cast<unsigned char *>(static_pixels), WORLD_WIDTH, WORLD_HEIGHT);
+    unsigned char * rows = new unsigned char [(long)TILE_SIZE*width];
+
+    launch_points.clear();
+    forget_saved_file();
+    memset(rows, display::GREEN, (long)TILE_SIZE*width); 
+    if (layout == WORLD_LINEAR) {
+        map_world_rows(-1);
+    } else {
+        reset_tiles();
+    }
+    for (int y = 0; y < height; y += TILE_SIZE) {
+        load_rows(y, rows);
+    }
+    delete [] rows;
+    create_texture();
 }
 
+// returns the FNV-1a hash of n bytes at p, continuing from hash h
+static unsigned long fnv1a(const void * p, size_t n, unsigned long h = 14695981039346656037UL)
+{
+    const unsigned char * b = reinterpret_cast<const unsigned char *>(p);
+
+    for (size_t i = 0; i < n; i++) {
+        h = (h ^ b[i]) * 1099511628211UL;
+    }
+    return h;
+}
+
+// reads a world file, or a legacy world file; a world file sets the world's size
 bool world::read(string filename)
 {
     ifstream ifs;
+    struct world_file_hdr hdr;
+
+    if (!replay_journal(filename)) {
+        WARNING(filename << " journal replay failed, the last write is lost" << endl);
+    }
 
-    ifs.open(filename, ios::in|ios::ate|ios::binary);
+    ifs.open(filename, ios::in|ios::binary);
     if (!ifs.is_open()) {
         ERROR(filename << " does not exist" << endl);
         return false;
     }
-    if (ifs.tellg() != WORLD_WIDTH*WORLD_HEIGHT) {
+
+    memset(&hdr, 0, sizeof(hdr));
+    ifs.read(reinterpret_cast<char*>(&hdr), sizeof(hdr));
+    if (ifs.good() && memcmp(hdr.magic, "AVWORLD", 8) == 0) {
+        return read_tiles(ifs, hdr, filename);
+    }
+
+    ifs.clear();
+    return read_legacy(ifs, filename);
+}
+
+// a legacy world file must be the world's size; a linear world maps the file, 
+// see map_world_rows, rather than reading it
+bool world::read_legacy(ifstream &ifs, string filename)
+{
+    ifs.seekg(0,ios::end);
+    if (ifs.tellg() != (long)width*height) {
         ERROR(filename << " has incorrect size" << endl);
         return false;
     }
     ifs.seekg(0,ios::beg);
-    ifs.read(reinterpret_cast<char*>(static_pixels), WORLD_WIDTH*WORLD_HEIGHT); 
+    launch_points.clear();
+    forget_saved_file();
+    if (layout == WORLD_LINEAR) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        bool mapped = map_world_rows(fd);
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (mapped) {
+            create_texture();
+            return true;
+        }
+        WARNING(filename << " mmap failed, reading it instead" << endl);
+    } else {
+        reset_tiles();
+    }
+
+    unsigned char * rows = new unsigned char [(long)TILE_SIZE*width];
+    for (int y = 0; y < height; y += TILE_SIZE) {
+        ifs.read(reinterpret_cast<char*>(rows), (long)TILE_SIZE*width); 
+        if (!ifs.good()) {
+            ERROR(filename << " read failed" << endl);
+            delete [] rows;
+            return false;
+        }
+        load_rows(y, rows);
+    }
+    delete [] rows;
+    create_texture();
+
+    return true;
+}
+
+// the tiles are decoded a row of tiles at a time, and loaded from there
+bool world::read_tiles(ifstream &ifs, const struct world_file_hdr &hdr, string filename)
+{
+    if (hdr.version != 1 && hdr.version != WORLD_FILE_VERSION) {
+        ERROR(filename << " has unsupported version " << hdr.version << endl);
+        return false;
+    }
+    if (!valid_world_size(hdr.width, hdr.height) ||
+        hdr.num_colors < 1 || hdr.num_colors > 256 ||
+        hdr.num_launch_points < 0 || hdr.num_launch_points > MAX_LAUNCH_POINTS) 
+    {
+        ERROR(filename << " has invalid header" << endl);
+        return false;
+    }
+
+    // read the palette, launch points, and tile index; pixel codes not in the 
+    // palette are -1
+    int tiles = (hdr.width / TILE_SIZE) * (hdr.height / TILE_SIZE);
+    unsigned char palette[256];
+    int code_color[256];
+    std::vector<struct launch_point> lp(hdr.num_launch_points);
+    std::vector<struct world_file_tile_entry> index;
+    ifs.read(reinterpret_cast<char*>(palette), hdr.num_colors);
+    ifs.read(reinterpret_cast<char*>(lp.data()), hdr.num_launch_points * sizeof(struct launch_point));
+    long index_offset = ifs.tellg();
+    if (hdr.version != 1) {
+        index.resize(tiles);
+        ifs.read(reinterpret_cast<char*>(index.data()), tiles * sizeof(struct world_file_tile_entry));
+    }
     if (!ifs.good()) {
         ERROR(filename << " read failed" << endl);
         return false;
     }
+    for (int i = 0; i < 256; i++) {
+        code_color[i] = (i < hdr.num_colors ? palette[i] : -1);
+    }
 
-    memcpy(pixels, static_pixels, WORLD_WIDTH*WORLD_HEIGHT);
-    d.texture_destroy(texture);
-    texture = d.texture_create(reinterpret_cast<unsigned char *>(static_pixels), WORLD_WIDTH, WORLD_HEIGHT);
+    // resize the world if needed, and clear the world rows or tiles
+    if (hdr.width != width || hdr.height != height) {
+        free_layers();
+        alloc_layers(hdr.width, hdr.height);
+    }
+    if (layout == WORLD_LINEAR) {
+        map_world_rows(-1);
+    } else {
+        reset_tiles();
+    }
+    launch_points = lp;
+    forget_saved_file();
+
+    unsigned char * rows = new unsigned char [(long)TILE_SIZE*width];
+    long live_bytes = 0;
+    int t = 0;
+    for (int y = 0; y < height; y += TILE_SIZE) {
+        for (int x = 0; x < width; x += TILE_SIZE, t++) {
+            bool ok;
+            if (hdr.version == 1) {
+                ok = decode_tile(ifs, code_color, &rows[x], width);
+            } else if (index[t].length == 0) {
+                int c = (index[t].offset >= 0 && index[t].offset < 256 ? code_color[index[t].offset] : -1);
+                ok = (c >= 0);
+                for (int i = 0; i < TILE_SIZE && ok; i++) {
+                    memset(&rows[(long)i*width+x], c, TILE_SIZE);
+                }
+            } else {
+                ifs.seekg(index[t].offset);
+                ok = decode_tile(ifs, code_color, &rows[x], width) && 
+                     ifs.tellg() == index[t].offset + index[t].length;
+                live_bytes += index[t].length;
+            }
+            if (!ok) {
+                ERROR(filename << " read failed, or has an invalid tile" << endl);
+                delete [] rows;
+                return false;
+            }
+        }
+        load_rows(y, rows);
+    }
+    delete [] rows;
+    create_texture();
+
+    // remember the file, so that the next write can just save the changed tiles
+    struct stat st;
+    if (hdr.version == WORLD_FILE_VERSION && stat(filename.c_str(), &st) == 0) {
+        saved_filename     = filename;
+        saved_ino          = st.st_ino;
+        saved_file_size    = st.st_size;
+        saved_index_offset = index_offset;
+        saved_live_bytes   = live_bytes;
+        saved_index.swap(index);
+    }
 
     return true;
 }
 
 bool world::write(string filename)
+{
+    return write_dirty_tiles(filename) || write_all(filename);
+}
+
+// the file is written to a temporary file that is then renamed, so that 
+// worlds that have the old file mapped keep seeing the old file, and a crash
+// leaves either the old file or the new one; the palette maps each code to 
+// the color of the same value
+bool world::write_all(string filename)
 {
     ofstream ofs;
+    string tmp_filename = filename + ".tmp." + std::to_string(getpid());
+    struct world_file_hdr hdr;
+    unsigned char palette[256];
+    std::vector<struct world_file_tile_entry> index(world_tiles());
 
-    ofs.open(filename, ios::out|ios::binary|ios::trunc);
+    ofs.open(tmp_filename, ios::out|ios::binary|ios::trunc);
     if (!ofs.is_open()) {
-        ERROR(filename << " create failed" << endl);
+        ERROR(tmp_filename << " create failed" << endl);
         return false;
     }
-    ofs.write(reinterpret_cast<char*>(static_pixels), WORLD_WIDTH*WORLD_HEIGHT);  
-    if (!ofs.good()) {
+
+    // write the header, palette, and launch points; and leave room for the
+    // tile index, which is written last
+    memset(&hdr, 0, sizeof(hdr));
+    strcpy(hdr.magic, "AVWORLD");
+    hdr.version           = WORLD_FILE_VERSION;
+    hdr.width             = width;
+    hdr.height            = height;
+    hdr.num_colors        = 256;
+    hdr.num_launch_points = launch_points.size();
+    for (int i = 0; i < 256; i++) {
+        palette[i] = i;
+    }
+    ofs.write(reinterpret_cast<char*>(&hdr), sizeof(hdr));
+    ofs.write(reinterpret_cast<char*>(palette), sizeof(palette));
+    ofs.write(reinterpret_cast<const char*>(launch_points.data()), launch_points.size() * sizeof(struct launch_point));
+    long index_offset = ofs.tellp();
+    ofs.write(reinterpret_cast<char*>(index.data()), index.size() * sizeof(struct world_file_tile_entry));
+
+    // write the tiles' data, a row of tiles at a time
+    unsigned char * rows = new unsigned char [(long)TILE_SIZE*width];
+    std::vector<unsigned char> out;
+    long offset = ofs.tellp();
+    long live_bytes = 0;
+    int t = 0;
+    for (int y = 0; y < height; y += TILE_SIZE) {
+        for (int i = 0; i < TILE_SIZE; i++) {
+            copy_row_out(STATIC_LAYER, 0, y+i, width, &rows[(long)i*width]);
+        }
+        out.clear();
+        for (int x = 0; x < width; x += TILE_SIZE, t++) {
+            size_t len = out.size();
+            encode_tile(&rows[x], width, out);
+            if (out[len] == TILE_UNIFORM) {
+                index[t].offset = out[len+1];
+                out.resize(len);
+            } else {
+                index[t].offset = offset + len;
+                index[t].length = out.size() - len;
+                live_bytes += index[t].length;
+            }
+        }
+        ofs.write(reinterpret_cast<char*>(out.data()), out.size());  
+        offset += out.size();
+    }
+    delete [] rows;
+
+    ofs.seekp(index_offset);
+    ofs.write(reinterpret_cast<char*>(index.data()), index.size() * sizeof(struct world_file_tile_entry));
+    ofs.close();
+    if (!ofs.good() || !rename_synced(tmp_filename, filename)) {
         ERROR(filename << " write failed" << endl);
+        unlink(tmp_filename.c_str());
+        return false;
+    }
+
+    // a journal left by an interrupted write is for the old file, and so
+    // won't be replayed; but remove it anyway
+    unlink((filename + ".journal").c_str());
+
+    // remember the file, so that the next write can just save the changed tiles
+    struct stat st;
+    forget_saved_file();
+    if (stat(filename.c_str(), &st) == 0) {
+        saved_filename     = filename;
+        saved_ino          = st.st_ino;
+        saved_file_size    = st.st_size;
+        saved_index_offset = index_offset;
+        saved_live_bytes   = live_bytes;
+        saved_index.swap(index);
+    }
+
+    return true;
+}
+
+// saves the changed tiles to the file last read or written, see the world file
+// comments in world.h; returns false if that can't be done, in which case the
+// file is unchanged or only has unused tile data appended
+bool world::write_dirty_tiles(string filename)
+{
+    struct stat st;
+
+    if (filename != saved_filename || 
+        stat(filename.c_str(), &st) != 0 ||
+        st.st_ino != saved_ino ||
+        st.st_size != saved_file_size) 
+    {
+        return false;
+    }
+    if (dirty_tiles.empty()) {
+        return true;
+    }
+
+    // encode the changed tiles
+    const int tiles_per_world_row = width / TILE_SIZE;
+    unsigned char tile[TILE_BYTES];
+    std::vector<unsigned char> out;
+    std::vector<struct world_file_journal_entry> journal(dirty_tiles.size());
+    long live_bytes = saved_live_bytes;
+    for (size_t i = 0; i < dirty_tiles.size(); i++) {
+        int t = dirty_tiles[i];
+        int x = (t % tiles_per_world_row) * TILE_SIZE;
+        int y = (t / tiles_per_world_row) * TILE_SIZE;
+        for (int j = 0; j < TILE_SIZE; j++) {
+            copy_row_out(STATIC_LAYER, x, y+j, TILE_SIZE, &tile[j*TILE_SIZE]);
+        }
+
+        struct world_file_journal_entry &je = journal[i];
+        size_t len = out.size();
+        memset(&je, 0, sizeof(je));
+        je.tile = t;
+        encode_tile(tile, TILE_SIZE, out);
+        if (out[len] == TILE_UNIFORM) {
+            je.entry.offset = out[len+1];
+            out.resize(len);
+        } else {
+            je.entry.offset = saved_file_size + len;
+            je.entry.length = out.size() - len;
+        }
+        live_bytes += je.entry.length - saved_index[t].length;
+    }
+
+    // if half the file would be unused tile data then write the whole file instead
+    if (saved_file_size + (long)out.size() > 2 * (saved_index_offset + 
+                                                  (long)saved_index.size() * (long)sizeof(struct world_file_tile_entry) +
+                                                  live_bytes)) 
+    {
+        return false;
+    }
+
+    // append the tiles' data; the file doesn't refer to it yet
+    int fd = open(filename.c_str(), O_WRONLY);
+    if (fd < 0) {
+        return false;
+    }
+    if (pwrite(fd, out.data(), out.size(), saved_file_size) != (ssize_t)out.size() || fsync(fd) != 0) {
+        close(fd);
+        return false;
+    }
+
+    // write the journal of tile index updates, followed by its checksum
+    string journal_filename = filename + ".journal";
+    struct world_file_journal_hdr jh;
+    memset(&jh, 0, sizeof(jh));
+    strcpy(jh.magic, "AVWJRNL");
+    jh.ino          = saved_ino;
+    jh.index_offset = saved_index_offset;
+    jh.num_entries  = journal.size();
+    size_t jlen = journal.size() * sizeof(struct world_file_journal_entry);
+    unsigned long checksum = fnv1a(&jh, sizeof(jh), fnv1a(journal.data(), jlen));
+    int jfd = open(journal_filename.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if (jfd < 0 ||
+        ::write(jfd, &jh, sizeof(jh)) != sizeof(jh) ||
+        ::write(jfd, journal.data(), jlen) != (ssize_t)jlen ||
+        ::write(jfd, &checksum, sizeof(checksum)) != sizeof(checksum) ||
+        fsync(jfd) != 0)
+    {
+        if (jfd >= 0) {
+            close(jfd);
+        }
+        unlink(journal_filename.c_str());
+        close(fd);
+        return false;
+    }
+    close(jfd);
+
+    // update the tile index; from here on a failure is recovered by replaying 
+    // the journal
+    bool ok = true;
+    for (size_t i = 0; i < journal.size(); i++) {
+        long offset = saved_index_offset + journal[i].tile * sizeof(struct world_file_tile_entry);
+        ok = ok && pwrite(fd, &journal[i].entry, sizeof(journal[i].entry), offset) == sizeof(journal[i].entry);
+    }
+    ok = ok && fsync(fd) == 0;
+    close(fd);
+    if (!ok) {
+        ERROR(filename << " write failed, it will be recovered when next read" << endl);
+        return false;
+    }
+    unlink(journal_filename.c_str());
+
+    // the saved file now has the changed tiles
+    for (size_t i = 0; i < journal.size(); i++) {
+        saved_index[journal[i].tile] = journal[i].entry;
+        tile_dirty[journal[i].tile] = false;
+    }
+    dirty_tiles.clear();
+    saved_file_size += out.size();
+    saved_live_bytes = live_bytes;
+
+    return true;
+}
+
+// replays the journal left by an interrupted write_dirty_tiles, if there's one;
+// a journal that's incomplete, or for another file, is just removed
+bool world::replay_journal(string filename)
+{
+    string journal_filename = filename + ".journal";
+    struct world_file_journal_hdr jh;
+    std::vector<struct world_file_journal_entry> journal;
+    unsigned long checksum;
+    struct stat st;
+
+    int jfd = open(journal_filename.c_str(), O_RDONLY);
+    if (jfd < 0) {
+        return true;
+    }
+    bool valid = (::read(jfd, &jh, sizeof(jh)) == sizeof(jh) &&
+                  memcmp(jh.magic, "AVWJRNL", 8) == 0 &&
+                  jh.num_entries >= 0 && jh.num_entries <= MAX_WORLD_WIDTH / TILE_SIZE * (MAX_WORLD_HEIGHT / TILE_SIZE));
+    if (valid) {
+        size_t jlen = jh.num_entries * sizeof(struct world_file_journal_entry);
+        journal.resize(jh.num_entries);
+        valid = (::read(jfd, journal.data(), jlen) == (ssize_t)jlen &&
+                 ::read(jfd, &checksum, sizeof(checksum)) == sizeof(checksum) &&
+                 checksum == fnv1a(&jh, sizeof(jh), fnv1a(journal.data(), jlen)) &&
+                 stat(filename.c_str(), &st) == 0 && 
+                 st.st_ino == jh.ino);
+    }
+    close(jfd);
+
+    if (valid) {
+        INFO("replaying " << journal_filename << endl);
+        int fd = open(filename.c_str(), O_WRONLY);
+        if (fd < 0) {
+            return false;
+        }
+        bool ok = true;
+        for (size_t i = 0; i < journal.size(); i++) {
+            long offset = jh.index_offset + journal[i].tile * sizeof(struct world_file_tile_entry);
+            ok = ok && pwrite(fd, &journal[i].entry, sizeof(journal[i].entry), offset) == sizeof(journal[i].entry);
+        }
+        ok = ok && fsync(fd) == 0;
+        close(fd);
+        if (!ok) {
+            return false;
+        }
+    }
+    unlink(journal_filename.c_str());
+    return true;
+}
+
+void world::forget_saved_file()
+{
+    saved_filename.clear();
+    saved_index.clear();
+    tile_dirty.assign(world_tiles(), false);
+    dirty_tiles.clear();
+}
+
+// decodes a tile to dst, whose rows are pitch apart; returns false if the 
+// read fails or the tile is invalid
+bool world::decode_tile(ifstream &ifs, const int * code_color, unsigned char * dst, int pitch)
+{
+    unsigned char buff[2*TILE_BYTES];
+    unsigned char tile[TILE_BYTES];
+    int type = ifs.get();
+
+    if (type == TILE_UNIFORM) {
+        int c = code_color[ifs.get() & 255];
+        if (!ifs.good() || c < 0) {
+            return false;
+        }
+        for (int i = 0; i < TILE_SIZE; i++) {
+            memset(&dst[(long)i*pitch], c, TILE_SIZE);
+        }
+        return true;
+    }
+
+    if (type == TILE_RLE) {
+        int len = ifs.get();
+        len |= ifs.get() << 8;
+        if (!ifs.good() || len <= 0 || len > 2*TILE_BYTES || (len & 1)) {
+            return false;
+        }
+        ifs.read(reinterpret_cast<char*>(buff), len);
+        if (!ifs.good()) {
+            return false;
+        }
+        int n = 0;
+        for (int i = 0; i < len; i += 2) {
+            int run = buff[i] + 1;
+            int c = code_color[buff[i+1]];
+            if (c < 0 || n + run > TILE_BYTES) {
+                return false;
+            }
+            memset(&tile[n], c, run);
+            n += run;
+        }
+        if (n != TILE_BYTES) {
+            return false;
+        }
+    } else if (type == TILE_RAW) {
+        ifs.read(reinterpret_cast<char*>(buff), TILE_BYTES);
+        if (!ifs.good()) {
+            return false;
+        }
+        for (int i = 0; i < TILE_BYTES; i++) {
+            int c = code_color[buff[i]];
+            if (c < 0) {
+                return false;
+            }
+            tile[i] = c;
+        }
+    } else {
+        return false;
+    }
+
+    for (int i = 0; i < TILE_SIZE; i++) {
+        memcpy(&dst[(long)i*pitch], &tile[i*TILE_SIZE], TILE_SIZE);
+    }
+    return true;
+}
+
+// appends the encoding of the tile at src, whose rows are pitch apart, to out;
+// runs are encoded unless that's no smaller than the raw tile
+void world::encode_tile(const unsigned char * src, int pitch, std::vector<unsigned char> &out)
+{
+    unsigned char tile[TILE_BYTES];
+    unsigned char runs[2*TILE_BYTES];
+    int len = 0;
+
+    for (int i = 0; i < TILE_SIZE; i++) {
+        memcpy(&tile[i*TILE_SIZE], &src[(long)i*pitch], TILE_SIZE);
+    }
+    for (int i = 0; i < TILE_BYTES; ) {
+        int run = 1;
+        while (i + run < TILE_BYTES && run < 256 && tile[i+run] == tile[i]) {
+            run++;
+        }
+        runs[len++] = run - 1;
+        runs[len++] = tile[i];
+        i += run;
+    }
+
+    bool uniform = true;
+    for (int i = 1; i < len/2 && uniform; i++) {
+        uniform = (runs[2*i+1] == runs[1]);
+    }
+
+    if (uniform) {
+        out.push_back(TILE_UNIFORM);
+        out.push_back(tile[0]);
+    } else if (len < TILE_BYTES) {
+        out.push_back(TILE_RLE);
+        out.push_back(len & 255);
+        out.push_back(len >> 8);
+        out.insert(out.end(), runs, runs+len);
+    } else {
+        out.push_back(TILE_RAW);
+        out.insert(out.end(), tile, tile+TILE_BYTES);
+    }
+}
+
+// gives a static layer that's a mapped world file memory of its own, which 
+// must be done before it's edited with set_static_pixel
+void world::materialize()
+{
+    if (!static_mapped) {
+        return;
+    }
+
+    long len = (long)width * height;
+    unsigned char * copy = new unsigned char [len];
+    memcpy(copy, &static_pixels[linear_offset(0,0)], len);
+    void * addr = mmap(&static_pixels[linear_offset(0,0)], len, PROT_READ|PROT_WRITE, 
+                       MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED, -1, 0);
+    if (addr == MAP_FAILED) {
+        FATAL("mmap world rows, " << strerror(errno) << endl);
+    }
+    memcpy(&static_pixels[linear_offset(0,0)], copy, len);
+    delete [] copy;
+    static_mapped = false;
+}
+
+bool world::add_launch_point(int x, int y, int dir)
+{
+    if (x < 0 || x >= width || y < 0 || y >= height || (int)launch_points.size() == MAX_LAUNCH_POINTS) {
         return false;
     }
 
+    // the file's launch points can't be changed in place, so the next write 
+    // writes the whole file
+    struct launch_point lp = { x, y, dir };
+    launch_points.push_back(lp);
+    forget_saved_file();
     return true;
 }
 
 void world::set_static_pixel(int x, int y, unsigned char p) 
 {
-    if (x < 0 || x >= WORLD_WIDTH || y < 0 || y >= WORLD_HEIGHT) {
+    if (x < 0 || x >= width || y < 0 || y >= height) {
         return;
     }
 
-    static_pixels[y][x] = p;
-    pixels[y][x] = p;
-    d.texture_set_pixel(texture, x, y, p);
+    show_placed_objects();
+
+    if (layout == WORLD_LINEAR) {
+        assert(!static_mapped);
+        long offset = linear_offset(x,y);
+        static_pixels[offset] = p;
+        pixels[offset] = p;
+    } else {
+        // a dynamic tile that shares the static tile's slot keeps sharing it
+        int t = tile_index(x,y);
+        int i = (y & TILE_MASK) << TILE_SHIFT | (x & TILE_MASK);
+        bool shared = (tile_dir[t] == static_tile_dir[t]);
+        writable_tile(STATIC_LAYER, t)[i] = p;
+        if (shared) {
+            tile_dir[t] = static_tile_dir[t];
+        } else {
+            writable_tile(DYNAMIC_LAYER, t)[i] = p;
+        }
+    }
+
+    // the pixel was also set in the dynamic layer, over any objects there; they're
+    // drawn again before the dynamic layer is next looked at
+    if (!shown_objects.empty()) {
+        std::lock_guard<std::mutex> objects_lck(objects_mutex);
+        static_changed_tiles.insert(tile_index(x,y));
+        objects_pending = true;
+    }
+
+    int t = (y / TILE_SIZE) * (width / TILE_SIZE) + (x / TILE_SIZE);
+    if (!tile_dirty[t]) {
+        tile_dirty[t] = true;
+        dirty_tiles.push_back(t);
+    }
+
+    add_dirty_rect(x, y, 1, 1);
 }
 
 unsigned char world::get_static_pixel(int x, int y)
 {
-    if (x < 0 || x >= WORLD_WIDTH || y < 0 || y >= WORLD_HEIGHT) {
+    if (x < 0 || x >= width || y < 0 || y >= height) {
         return display::GREEN;
     }
 
-    return static_pixels[y][x];
+    return *pixel_ptr(STATIC_LAYER,x,y);
 }
 
 unsigned char world::get_world_pixel(int x, int y)
 {
-    if (x < 0 || x >= WORLD_WIDTH || y < 0 || y >= WORLD_HEIGHT) {
+    if (x < 0 || x >= width || y < 0 || y >= height) {
         return display::GREEN;
     }
 
-    return pixels[y][x];
+    show_placed_objects();
+    return pixel(x,y);
 }
 
 void world::cvt_coord_pixel_to_world(double pixel_x, double pixel_y, int &world_x, int &world_y)
 {
     assert(zoom != 0);
-    int  world_display_width  = WORLD_WIDTH / zoom;
-    int  world_display_height = WORLD_HEIGHT / zoom;
+    int  world_display_width  = width / zoom;
+    int  world_display_height = height / zoom;
 
     world_x = (center_x - world_display_width / 2) + (world_display_width * pixel_x);
     world_y = (center_y - world_display_height / 2) + (world_display_height * pixel_y);
@@ -276,8 +2004,8 @@ void world::cvt_coord_pixel_to_world(double pixel_x, double pixel_y, int &world_
 void world::cvt_coord_world_to_pixel(int world_x, int world_y, double &pixel_x, double &pixel_y)
 {
     assert(zoom != 0);
-    int  world_display_width  = WORLD_WIDTH / zoom;
-    int  world_display_height = WORLD_HEIGHT / zoom;
+    int  world_display_width  = width / zoom;
+    int  world_display_height = height / zoom;
 
     pixel_x = (double)(world_x - (center_x - world_display_width / 2)) / world_display_width;
     pixel_y = (double)(world_y - (center_y - world_display_height / 2)) / world_display_height;
@@ -24,28 +24,80 @@ SOFTWARE.
 #define __WORLD_H__
 
 #include <string>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <fstream>
 #include "display.h"
 
 using std::string;
 
 class world {
 public:
+    // default world size; worlds may be any multiple of 64 pixels in each direction,
+    // up to 65536, where a tiled world's directories take 4 MB each and its tile
+    // pool reserves 8 GB of address space
     static const int WORLD_WIDTH = 4096;
     static const int WORLD_HEIGHT = 4096;
+    static const int MAX_WORLD_WIDTH = 1 << 16;
+    static const int MAX_WORLD_HEIGHT = 1 << 16;
+
+    enum get_view_engine { GET_VIEW_STEP, GET_VIEW_TABLE };
+    enum get_view_sampling { GET_VIEW_WHOLE_DEGREE, GET_VIEW_NEAREST, GET_VIEW_BILINEAR };
+    enum world_layout { WORLD_LINEAR, WORLD_TILED };
+
+    // get_view per heading coefficients, and the view origin used by get_view_segment
+    struct get_view_coeff {
+        double cosdir;
+        double sindir;
+        long   cos_fp;
+        long   sin_fp;
+        bool   eval_in_double;
+        bool   folds_exactly;
+    };
+    enum view_sampler { VIEW_STEP, VIEW_TABLE, VIEW_BILINEAR };
+    struct launch_point {
+        int x, y, dir;
+    };
+    struct view_origin {
+        int x, y, W, H;
+        bool checked;
+        enum view_sampler sampler;
+        int d;
+        struct get_view_coeff c;
+    };
     
     static void static_init();
+    static void set_world_layout(enum world_layout layout) { world_layout = layout; }
+    static enum world_layout get_world_layout() { return world_layout; }
+    static void set_get_view_engine(enum get_view_engine engine) { get_view_engine = engine; }
+    static void set_get_view_tbl_cache(string filename) { get_view_tbl_cache_filename = filename; }
+    static enum get_view_engine get_get_view_engine() { return get_view_engine; }
+    static void set_get_view_sampling(enum get_view_sampling sampling) { get_view_sampling = sampling; }
+    static enum get_view_sampling get_get_view_sampling() { return get_view_sampling; }
+    static bool valid_world_size(int width, int height);
 
-    world(display &display);
+    world(display &display, int width = WORLD_WIDTH, int height = WORLD_HEIGHT);
     ~world();
 
+    int get_width() { return width; }
+    int get_height() { return height; }
+    const std::vector<struct launch_point> &get_launch_points() { return launch_points; }
+    bool add_launch_point(int x, int y, int dir);
+
     void place_object_init();
-    void place_object(int x, int y, int w, int h, unsigned char * pixels);
+    void place_object(int x, int y, int w, int h, unsigned char * pixels, unsigned char * mask = NULL);
     void draw(int pid, int center_x, int center_y, double zoom);
 
     void get_view(int x, int y, double dir, int w, int h, unsigned char * pixels);
+    void init_view_origin(struct view_origin &vo, int x, int y, double dir, int w, int h);
+    void get_view_segment(const struct view_origin &vo, int row, int col, int n, unsigned char * pixels);
 
     void clear();
     bool read(string filename);
+    void materialize();
     bool write(string filename);
     void set_static_pixel(int x, int y, unsigned char c);
     unsigned char get_static_pixel(int x, int y);
@@ -57,19 +109,249 @@ private:
     display &d;
 
     // world data
+    //   the world is width x height pixels, surrounded by a guard band of WORLD_GUARD 
+    //   pixels; the guard band is PURPLE (off the world) in the dynamic layer, so 
+    //   that views which stay within it can be sampled without bounds checks. the
+    //   static layer holds the roads, and the dynamic layer the roads with the 
+    //   placed objects on top.
+    //
+    //   WORLD_LINEAR layers are row major buffers, static_pixels and pixels, width
+    //   pixels wide, with guard band rows above and below the world; there's no 
+    //   guard band at the sides, so that the world rows are laid out just like a
+    //   raw world file. read maps such a file in place of the world rows: shared 
+    //   and read only for the static layer, and private (copy on write) for the 
+    //   dynamic layer, so only the pages that objects are placed on get copied. 
+    //   materialize gives the static layer memory of its own, for editing.
+    //   the static layer's guard band isn't read.
+    //
+    //   WORLD_TILED layers are made of 64x64 pixel tiles, which keeps rotated views
+    //   within a small set of cache lines and pages whatever their heading. the 
+    //   tiles are kept in the slots of tile_pool, and static_tile_dir and tile_dir
+    //   give the slot of each of the layer's tiles. slots 0 to 255 hold tiles of a 
+    //   single color, shared by all the tiles of that color, and the dynamic layer 
+    //   shares the static layer's slot wherever there's no object; so only tiles 
+    //   that are painted, or have objects on them, use memory of their own. a tile 
+    //   gets a slot of its own when it's first written. tile_pool is just reserved
+    //   address space, a slot's pages are allocated when it's first used; it has
+    //   a slot for each of the world's tiles in both layers, so it can't fill up. 
+    //   the static layer's guard band is GREEN.
+    //
+    //   pixel_ptr gives the location of a layer's pixel, and row_run how many 
+    //   pixels from there on are stored contiguously
+    static const int MAX_GET_VIEW_XY = 500;
+    static const int TILE_SHIFT = 6;
+    static const int TILE_SIZE = 1 << TILE_SHIFT;
+    static const int TILE_MASK = TILE_SIZE - 1;
+    static const int TILE_BYTES = TILE_SIZE * TILE_SIZE;
+    static const int WORLD_GUARD = (MAX_GET_VIEW_XY + TILE_MASK) & ~TILE_MASK;
+    static const int UNIFORM_TILE_SLOTS = 256;
+    static const int MAX_TEXTURE_SIZE = 4096;
+    static const int MAX_DIRTY_RECTS = 4096;
     struct rect {
         int x,y,w,h;
     };
-    unsigned char (*static_pixels)[WORLD_WIDTH];
-    unsigned char (*pixels)[WORLD_WIDTH];
+    enum layer { STATIC_LAYER, DYNAMIC_LAYER };
+    static enum world_layout world_layout;
+    enum world_layout layout;
+    int width;
+    int height;
+    int buff_height;
+    int tiles_per_row;
+    unsigned char *static_pixels;
+    unsigned char *pixels;
+    bool static_mapped;
+    unsigned int *static_tile_dir;
+    unsigned int *tile_dir;
+    unsigned char *tile_pool;
+    unsigned int max_tile_slots;
+    unsigned int next_tile_slot;
+    std::vector<unsigned int> free_tile_slots;
+    bool uniform_tile_ready[UNIFORM_TILE_SLOTS];
     display::texture *texture;
-    struct rect placed_object_list[1000];
-    int max_placed_object_list;
+    int texture_scale;
+    // the rects of the world whose texture is out of date; they're merged and
+    // uploaded when the world is drawn, so frames that aren't drawn upload nothing
+    std::vector<struct rect> dirty_rects;
+    std::vector<unsigned char> texture_buff;
+
+    // placed objects
+    //   the dynamic layer is the static layer with the objects drawn on top, kept
+    //   up to date incrementally: place_object just lists the objects placed since
+    //   place_object_init, and before the dynamic layer is next looked at the list
+    //   is compared with the objects that are drawn, shown_objects. only the 
+    //   objects that have moved, or are new or gone, are erased or drawn, along with
+    //   any others in the tiles they're in, so that overlapping objects are drawn
+    //   in order. tile_objects counts the shown objects in each tile of a tiled 
+    //   world, so that a tile with none can be given back the static layer's slot.
+    //   static_changed_tiles are the tiles whose static pixels were set since the
+    //   objects were last drawn; the objects in them are drawn again.
+    struct placed_object {
+        struct rect rect;
+        const unsigned char * pixels;
+        const unsigned char * mask;
+    };
+    std::vector<struct placed_object> placed_objects;
+    std::vector<struct placed_object> shown_objects;
+    std::unordered_map<int,int> tile_objects;
+    std::unordered_set<int> static_changed_tiles;
+    std::atomic<bool> objects_pending;
+    std::mutex objects_mutex;
+
+    long linear_offset(int x, int y) {
+        return (long)(y + WORLD_GUARD) * width + x;
+    }
+    int tile_index(int x, int y) {
+        return ((y + WORLD_GUARD) >> TILE_SHIFT) * tiles_per_row + ((x + WORLD_GUARD) >> TILE_SHIFT);
+    }
+    long tiled_offset(const unsigned int * dir, int x, int y) {
+        return (long)dir[tile_index(x,y)] << (2 * TILE_SHIFT) | (y & TILE_MASK) << TILE_SHIFT | (x & TILE_MASK);
+    }
+    const unsigned char * pixel_ptr(enum layer l, int x, int y) {
+        return layout == WORLD_LINEAR ? &(l == STATIC_LAYER ? static_pixels : pixels)[linear_offset(x,y)]
+                                      : &tile_pool[tiled_offset(l == STATIC_LAYER ? static_tile_dir : tile_dir, x, y)];
+    }
+    unsigned char pixel(int x, int y) {
+        return layout == WORLD_LINEAR ? pixels[linear_offset(x,y)] : tile_pool[tiled_offset(tile_dir,x,y)];
+    }
+    int row_run(int x, int n) {
+        return (layout == WORLD_LINEAR || TILE_SIZE - (x & TILE_MASK) >= n) ? n : TILE_SIZE - (x & TILE_MASK);
+    }
+    std::vector<struct launch_point> launch_points;
+
+    void alloc_layers(int width, int height);
+    void free_layers();
+    void copy_row_out(enum layer l, int x, int y, int n, unsigned char * dst);
+    bool map_world_rows(int fd);
+    void load_rows(int y, const unsigned char * src);
+    void reset_tiles();
+    unsigned int alloc_tile_slot();
+    unsigned int uniform_tile_slot(unsigned char c);
+    unsigned char * writable_tile(enum layer l, int t);
+    void show_placed_objects() {
+        if (objects_pending) {
+            update_shown_objects();
+        }
+    }
+    void update_shown_objects();
+    void forget_objects();
+    void erase_object(const struct placed_object &obj);
+    void draw_object(const struct placed_object &obj, bool is_new);
+    void create_texture();
+    void update_texture(int x, int y, int w, int h);
+    void add_dirty_rect(int x, int y, int w, int h);
+    void merge_dirty_rects();
+    void flush_texture();
+
+    // world file
+    //   a world file is a world_file_hdr, followed by the palette, num_colors 
+    //   bytes giving the color of each pixel code, num_launch_points 
+    //   launch_points, and the tile index; then the tile data. the tile index
+    //   has a world_file_tile_entry for each of the world's 64x64 pixel tiles, 
+    //   in row major order, giving the offset and length of the tile's data; 
+    //   a length of 0 is a tile of a single color, whose code is the offset.
+    //   a tile's data is a world_file_tile byte followed by
+    //   - TILE_UNIFORM: the code of the tile's only color
+    //   - TILE_RLE: a 2 byte length, and that many bytes of runs, each a run 
+    //     length less 1 and a code, covering the tile in row major order
+    //   - TILE_RAW: the tile's codes, in row major order
+    //   version 1 files have no tile index, the tiles follow the launch points;
+    //   legacy world files are just the world's pixels, in row major order.
+    //
+    //   write saves just the tiles changed by set_static_pixel, when the file
+    //   is the one last read or written, by appending their data and pointing 
+    //   the tile index at it. the index updates are first written to a journal, 
+    //   filename.journal, which read replays if a write was interrupted. the 
+    //   whole file is written, to a temporary file that's renamed, when the 
+    //   launch points change or when half the file would be unused tile data.
+    static const int WORLD_FILE_VERSION = 2;
+    static const int MAX_LAUNCH_POINTS = 1000;
+    enum world_file_tile { TILE_UNIFORM, TILE_RLE, TILE_RAW };
+    struct world_file_hdr {
+        char magic[8];
+        int  version;
+        int  width;
+        int  height;
+        int  num_colors;
+        int  num_launch_points;
+    };
+    struct world_file_tile_entry {
+        long offset;
+        int  length;
+        int  reserved;
+    };
+    struct world_file_journal_hdr {
+        char          magic[8];
+        unsigned long ino;
+        long          index_offset;
+        int           num_entries;
+        int           reserved;
+    };
+    struct world_file_journal_entry {
+        long                         tile;
+        struct world_file_tile_entry entry;
+    };
+    string saved_filename;
+    unsigned long saved_ino;
+    long saved_file_size;
+    long saved_index_offset;
+    long saved_live_bytes;
+    std::vector<struct world_file_tile_entry> saved_index;
+    std::vector<bool> tile_dirty;
+    std::vector<int> dirty_tiles;
+
+    int world_tiles() { return (width / TILE_SIZE) * (height / TILE_SIZE); }
+    void forget_saved_file();
+    bool read_legacy(std::ifstream &ifs, string filename);
+    bool read_tiles(std::ifstream &ifs, const struct world_file_hdr &hdr, string filename);
+    bool write_all(string filename);
+    bool write_dirty_tiles(string filename);
+    static bool replay_journal(string filename);
+    static bool decode_tile(std::ifstream &ifs, const int * code_color, unsigned char * dst, int pitch);
+    static void encode_tile(const unsigned char * src, int pitch, std::vector<unsigned char> &out);
 
     // get view 
-    static const int MAX_GET_VIEW_XY = 500;
-    static short get_view_dx_tbl[360][MAX_GET_VIEW_XY][MAX_GET_VIEW_XY];
-    static short get_view_dy_tbl[360][MAX_GET_VIEW_XY][MAX_GET_VIEW_XY];
+    static const int GET_VIEW_FP_SHIFT = 32;
+    static enum get_view_engine get_view_engine;
+    static enum get_view_sampling get_view_sampling;
+    static bool get_view_avx2;
+    static struct get_view_coeff get_view_coeff_tbl[360];
+    static const int GET_VIEW_TBL_HEADINGS = 46;                 // base headings, 0 to 45 degrees
+    static const int GET_VIEW_TBL_WIDTH = MAX_GET_VIEW_XY + 1;   // w from -250 to 250
+    static const int GET_VIEW_TBL_CACHE_VERSION = 1;
+    static const int GET_VIEW_TBL_CACHE_HDR_SIZE = 4096;
+    struct get_view_tbl_cache_hdr {
+        char magic[8];
+        int  version;
+        int  headings;
+        int  height;
+        int  width;
+    };
+    static string get_view_tbl_cache_filename;
+    static bool get_view_tbl_cache_tried;
+    static std::mutex get_view_tbl_mutex;
+    static std::atomic<bool> get_view_tbl_built[GET_VIEW_TBL_HEADINGS];
+    static short (*get_view_dx_tbl[GET_VIEW_TBL_HEADINGS])[GET_VIEW_TBL_WIDTH];
+    static short (*get_view_dy_tbl[GET_VIEW_TBL_HEADINGS])[GET_VIEW_TBL_WIDTH];
+
+    static double fold_direction(double dir, int &quarter, bool &mirror);
+    static void init_get_view_coeff(double dir, struct get_view_coeff &c);
+    static void init_get_view_tbl(int d1);
+    static void fill_get_view_tbl(int d1, short (*dx_tbl)[GET_VIEW_TBL_WIDTH], short (*dy_tbl)[GET_VIEW_TBL_WIDTH]);
+    static bool map_get_view_tbl_cache();
+    bool get_view_in_guard_band(int x, int y, int W, int H);
+    void get_view_row(const struct view_origin &vo, int h, int w0, int len, unsigned char * pixels);
+    void get_view_table_row(int x, int y, int d, int h, int w0, int len, bool checked, unsigned char * pixels);
+    void get_view_step_row(int x, int y, const struct get_view_coeff &c, int h, int w0, int len, 
+                           bool checked, unsigned char * pixels);
+    void get_view_bilinear_row(int x, int y, const struct get_view_coeff &c, int h, int w0, int len, 
+                               bool checked, unsigned char * pixels);
+#if defined(__x86_64__)
+    __attribute__((target("avx2")))
+    int get_view_run_avx2(long ax, long ay, long cos_fp, long sin_fp, int n, unsigned char * pixels);
+#endif
+    unsigned char get_view_pixel(int x, int y) {
+        return ((unsigned)x < (unsigned)width && (unsigned)y < (unsigned)height) ? pixel(x,y) : display::PURPLE;
+    }
 
     // last draw
     int center_x;